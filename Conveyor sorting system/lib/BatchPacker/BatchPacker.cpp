@@ -0,0 +1,143 @@
+#include "BatchPacker.h"
+
+// ---------------- GiveawayModel ----------------
+
+void GiveawayModel::configure(float targetG) {
+  target_ = (targetG > 0.0f) ? targetG : 1.0f;
+  // 1 g resolution when it fits, coarser for large targets
+  steps_ = (size_t)target_ + 1;
+  if (steps_ > MAX_STEPS) steps_ = MAX_STEPS;
+  step_ = target_ / (steps_ - 1);  // steps_ >= 2 since target_ >= 1
+  ready_ = false;
+  dirty_ = count_ >= MIN_SAMPLES;
+}
+
+void GiveawayModel::addSample(float g) {
+  if (g <= 0.0f) return;
+  samples_[next_] = g;
+  next_ = (next_ + 1 == SAMPLES) ? 0 : next_ + 1;
+  if (count_ < SAMPLES) count_++;
+  sinceRebuild_++;
+  if (count_ >= MIN_SAMPLES && (!ready_ || sinceRebuild_ >= REBUILD_EVERY)) {
+    dirty_ = true;
+  }
+}
+
+void GiveawayModel::rebuild() {
+  dirty_ = false;
+  sinceRebuild_ = 0;
+  if (count_ < MIN_SAMPLES || steps_ < 2) return;
+
+  // Reduce the samples to SUPPORT buckets: (mean weight, probability)
+  float lo = samples_[0], hi = samples_[0];
+  for (size_t i = 1; i < count_; i++) {
+    if (samples_[i] < lo) lo = samples_[i];
+    if (samples_[i] > hi) hi = samples_[i];
+  }
+  float sum[SUPPORT] = {};
+  uint16_t n[SUPPORT] = {};
+  float width = (hi - lo) / SUPPORT;
+  for (size_t i = 0; i < count_; i++) {
+    size_t b = (width > 0.0f) ? (size_t)((samples_[i] - lo) / width) : 0;
+    if (b >= SUPPORT) b = SUPPORT - 1;
+    sum[b] += samples_[i];
+    n[b]++;
+  }
+  float w[SUPPORT], p[SUPPORT];
+  size_t k = 0;
+  for (size_t b = 0; b < SUPPORT; b++) {
+    if (!n[b]) continue;
+    w[k] = sum[b] / n[b];
+    p[k] = (float)n[b] / count_;
+    k++;
+  }
+
+  // G(0) = 0; G(r) only needs values below r, so one ascending pass
+  table_[0] = 0.0f;
+  for (size_t i = 1; i < steps_; i++) {
+    float r = i * step_;
+    float g = 0.0f;
+    for (size_t j = 0; j < k; j++) {
+      float rest = r - w[j];
+      if (rest <= 0.0f) {
+        g += p[j] * -rest;
+      } else {
+        float x = rest / step_;
+        size_t a = (size_t)x;
+        float f = x - a;
+        float next = (a + 1 < i) ? table_[a + 1] : table_[a];  // Item under one step
+        g += p[j] * (table_[a] + f * (next - table_[a]));
+      }
+    }
+    table_[i] = g;
+  }
+  ready_ = true;
+}
+
+float GiveawayModel::expected(float residualG) const {
+  if (!ready_ || residualG <= 0.0f) return 0.0f;
+  float x = residualG / step_;
+  size_t a = (size_t)x;
+  if (a >= steps_ - 1) return table_[steps_ - 1];
+  float f = x - a;
+  return table_[a] + f * (table_[a + 1] - table_[a]);
+}
+
+// ---------------- BatchPacker ----------------
+
+void BatchPacker::configure(float targetG) {
+  target_ = (targetG > 0.0f) ? targetG : 1.0f;
+  model_.configure(target_);
+}
+
+PackDecision BatchPacker::place(float g) {
+  PackDecision d = {};
+  model_.addSample(g);
+
+  // Smallest change in expected giveaway; ties go to the fuller bin
+  float best = 0.0f;
+  for (int b = 0; b < MAX_BINS; b++) {
+    if (!(mask_ & (1 << b))) continue;
+    float r = target_ - fill_[b];
+    float after = (g >= r) ? g - r : model_.expected(r - g);
+    float delta = after - model_.expected(r);
+    if (d.bin == 0 || delta < best || (delta == best && fill_[b] > fill_[d.bin - 1])) {
+      best = delta;
+      d.bin = b + 1;
+    }
+  }
+  if (d.bin == 0) return d;
+
+  int i = d.bin - 1;
+  fill_[i] += g;
+  items_[i]++;
+  c_.items++;
+  if (fill_[i] >= target_) {
+    d.completes = true;
+    d.packItems = items_[i];
+    d.packG = fill_[i];
+    d.giveawayG = fill_[i] - target_;
+    c_.packs++;
+    c_.packedG += d.packG;
+    c_.giveawayG += d.giveawayG;
+    fill_[i] = 0.0f;
+    items_[i] = 0;
+  }
+  return d;
+}
+
+void BatchPacker::maintain() {
+  if (model_.rebuildDue()) model_.rebuild();
+}
+
+bool BatchPacker::emptyBin(int bin) {
+  if (bin < 1 || bin > MAX_BINS) return false;
+  fill_[bin - 1] = 0.0f;
+  items_[bin - 1] = 0;
+  return true;
+}
+
+void BatchPacker::clear() {
+  for (int b = 1; b <= MAX_BINS; b++) emptyBin(b);
+  c_ = {};
+}
@@ -0,0 +1,107 @@
+/************************************************************
+ * BatchPacker - Target-weight batching (combination weighing)
+ *
+ * Each pack bin keeps its running fill. A bin is complete once
+ * its fill reaches the target; whatever is above the target is
+ * giveaway. Every incoming item goes to the bin where it adds
+ * the least *expected* giveaway:
+ *
+ *   G(r) = E_w[ w >= r ? w - r : G(r - w) ]
+ *
+ * is the giveaway still to come for a bin that lacks r grams,
+ * if it keeps receiving items from the observed weight
+ * distribution. Putting item w into a bin lacking r changes the
+ * expectation from G(r) to (w - r) if it completes the pack,
+ * else to G(r - w); the bin with the smallest change wins.
+ *
+ * G is a table over r = 0..target (at most MAX_STEPS points),
+ * rebuilt by dynamic programming from the last SAMPLES weights
+ * reduced to SUPPORT buckets: O(MAX_STEPS * SUPPORT) per rebuild,
+ * done outside the sort path. A decision is O(bins) table
+ * lookups. Memory is fixed (~9 KB).
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class GiveawayModel {
+public:
+  static const size_t MAX_STEPS = 2048;  // Table points over 0..target
+  static const size_t SAMPLES = 256;     // Recent weights kept
+  static const size_t SUPPORT = 32;      // Distribution buckets used by the DP
+  static const size_t MIN_SAMPLES = 8;   // Below this G is taken as 0
+  static const size_t REBUILD_EVERY = 32;
+
+  // Clears the table (samples are kept).
+  void configure(float targetG);
+  void addSample(float g);
+
+  bool rebuildDue() const { return dirty_; }
+  void rebuild();
+
+  bool ready() const { return ready_; }
+  float expected(float residualG) const;  // G(r)
+
+private:
+  float target_ = 0.0f;
+  float step_ = 1.0f;   // Grams per table point
+  size_t steps_ = 0;
+  float table_[MAX_STEPS];
+  bool ready_ = false;
+  bool dirty_ = false;
+
+  float samples_[SAMPLES];
+  size_t next_ = 0;
+  size_t count_ = 0;
+  size_t sinceRebuild_ = 0;
+};
+
+struct PackDecision {
+  int bin;             // 1-based, 0 = no pack bin enabled
+  bool completes;      // This item completed the pack
+  uint16_t packItems;  // Items in the completed pack (when completes)
+  float packG;         // Completed pack weight (when completes)
+  float giveawayG;     // packG - target (when completes)
+};
+
+struct PackCounters {
+  uint32_t items;
+  uint32_t packs;
+  double packedG;     // Weight of all completed packs
+  double giveawayG;   // Sum of giveaway of all completed packs
+};
+
+class BatchPacker {
+public:
+  static const int MAX_BINS = 3;
+
+  // Keeps the fills; the model table is rebuilt for the new target.
+  void configure(float targetG);
+  // Bit (bin - 1) set = bin takes part in packing.
+  void setBinMask(uint8_t mask) { mask_ = mask; }
+
+  PackDecision place(float g);
+
+  // Outside the sort path (loop()): rebuild G if enough new samples.
+  void maintain();
+
+  float target() const { return target_; }
+  float fill(int bin) const { return fill_[bin - 1]; }
+  uint16_t itemsIn(int bin) const { return items_[bin - 1]; }
+  const PackCounters& counters() const { return c_; }
+  const GiveawayModel& model() const { return model_; }
+
+  bool emptyBin(int bin);  // Pack removed by hand (incomplete); false: no such bin
+  void clear();            // All bins empty, counters cleared
+
+private:
+  float target_ = 0.0f;  // Set by configure()
+  uint8_t mask_ = 0x7;
+  float fill_[MAX_BINS] = {};
+  uint16_t items_[MAX_BINS] = {};
+  PackCounters c_ = {};
+  GiveawayModel model_;
+};
@@ -0,0 +1,97 @@
+#include "BeltProfile.h"
+
+#include <math.h>
+
+void BeltProfile::configure(float maxAccel, float jerk) {
+  A_ = (maxAccel > 0.0f) ? maxAccel : 1.0f;
+  J_ = (jerk > 0.0f) ? jerk : 0.0f;
+}
+
+void BeltProfile::reset(float speed) {
+  v0_ = v1_ = v_ = speed;
+  B0_ = Ap_ = T1_ = T2_ = T_ = t_ = 0.0f;
+}
+
+void BeltProfile::moveTo(float target) {
+  float a0 = accel();
+  v0_ = v_;
+  v1_ = target;
+  t_ = 0.0f;
+
+  if (J_ == 0.0f) {
+    // Trapezoid: constant accel for the whole change, jumps allowed
+    dir_ = (v1_ >= v0_) ? 1.0f : -1.0f;
+    B0_ = Ap_ = A_;
+    T1_ = 0.0f;
+    T2_ = fabsf(v1_ - v0_) / A_;
+    T_ = T2_;
+    return;
+  }
+
+  // Speed still gained while a0 ramps to zero decides the direction
+  float settle = a0 * fabsf(a0) / (2.0f * J_);
+  dir_ = (v1_ - v0_ >= settle) ? 1.0f : -1.0f;
+  B0_ = dir_ * a0;
+  if (B0_ > A_) B0_ = A_;  // Only after a smaller A from configure()
+  float dv = dir_ * (v1_ - v0_);
+
+  float p2 = J_ * dv + 0.5f * B0_ * B0_;
+  Ap_ = sqrtf(p2 > 0.0f ? p2 : 0.0f);
+  if (Ap_ < B0_) Ap_ = B0_;  // Rounding at dv == settle
+  T2_ = 0.0f;
+  if (Ap_ > A_) {
+    Ap_ = A_;
+    T2_ = (dv - (2.0f * A_ * A_ - B0_ * B0_) / (2.0f * J_)) / A_;
+  }
+  T1_ = (Ap_ - B0_) / J_;
+  T_ = T1_ + T2_ + Ap_ / J_;
+}
+
+float BeltProfile::speedAt(float t) const {
+  if (t >= T_) return v1_;
+  float dv;
+  if (t < T1_) {
+    dv = B0_ * t + 0.5f * J_ * t * t;
+  } else if (t < T1_ + T2_) {
+    dv = B0_ * T1_ + 0.5f * J_ * T1_ * T1_ + Ap_ * (t - T1_);
+  } else {
+    // Last phase ends at zero accel, counted back from the end
+    float r = T_ - t;
+    return v1_ - dir_ * 0.5f * J_ * r * r;
+  }
+  return v0_ + dir_ * dv;
+}
+
+float BeltProfile::update(float dtS) {
+  if (t_ >= T_) {
+    v_ = v1_;
+    return v_;
+  }
+  t_ += dtS;
+  v_ = speedAt(t_);
+  return v_;
+}
+
+float BeltProfile::accel() const {
+  if (t_ >= T_) return 0.0f;
+  float a;
+  if (t_ < T1_) {
+    a = B0_ + J_ * t_;
+  } else if (t_ < T1_ + T2_) {
+    a = Ap_;
+  } else {
+    a = J_ * (T_ - t_);
+  }
+  return dir_ * a;
+}
+
+float BeltProfile::distance() const {
+  // Integrate each phase (no longer point-symmetric once B0 != 0)
+  float t3 = T_ - T1_ - T2_;
+  float x1 = B0_ * T1_ * T1_ / 2.0f + J_ * T1_ * T1_ * T1_ / 6.0f;
+  float va = B0_ * T1_ + 0.5f * J_ * T1_ * T1_;  // Change at end of phase 1
+  float x2 = va * T2_ + 0.5f * Ap_ * T2_ * T2_;
+  float vb = va + Ap_ * T2_;
+  float x3 = vb * t3 + 0.5f * Ap_ * t3 * t3 - J_ * t3 * t3 * t3 / 6.0f;
+  return v0_ * T_ + dir_ * (x1 + x2 + x3);
+}
@@ -0,0 +1,68 @@
+/************************************************************
+ * BeltProfile - Jerk-limited (S-curve) belt speed setpoints
+ *
+ * FastAccelStepper ramps with a constant acceleration, so the
+ * acceleration jumps from 0 to ACCEL at every start, stop and
+ * speed change; that step is what makes products slide. This
+ * class plans a 7-segment style speed change instead
+ * (jerk up, constant accel, jerk down) from the current speed and
+ * acceleration to a target reached with zero acceleration, and is
+ * sampled every few ms to feed setSpeedInHz().
+ *
+ * A new plan starts from the acceleration the old one had at that
+ * moment, so a STOP in the middle of a start first ramps the
+ * acceleration down at the jerk limit instead of flipping it.
+ * With b0 the start accel counted in the direction of the change
+ * (negative when it points away) and dv the remaining change:
+ *   phase 1: accel b0 -> P at jerk J,  T1 = (P - b0)/J
+ *   phase 2: accel P,                  T2
+ *   phase 3: accel P -> 0 at jerk J,   T3 = P/J
+ *   dv = (2P^2 - b0^2)/(2J) + P*T2
+ * P = sqrt(J*dv + b0^2/2) with T2 = 0, or P = A when that is
+ * larger. The direction is the sign of dv minus what ramping b0
+ * straight to zero already adds (b0*|b0|/2J); a speed overshoot
+ * is only possible when the acceleration points the wrong way.
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+class BeltProfile {
+public:
+  // steps/s^2 and steps/s^3; jerk <= 0 gives a plain trapezoid.
+  void configure(float maxAccel, float jerk);
+
+  // Plan a change from the current setpoint to `target` (steps/s).
+  // Called mid-ramp, the new plan starts from the current speed and
+  // acceleration.
+  void moveTo(float target);
+
+  // Jump to `speed` with nothing planned (motor stopped: 0).
+  void reset(float speed);
+
+  // Advance by dt seconds and return the speed setpoint.
+  float update(float dtS);
+
+  bool done() const { return t_ >= T_; }
+  float speed() const { return v_; }
+  float target() const { return v1_; }
+  float accel() const;          // Current planned acceleration (signed)
+  float duration() const { return T_; }
+  float distance() const;       // Steps covered by the whole plan
+
+private:
+  float speedAt(float t) const;
+
+  float A_ = 1.0f;
+  float J_ = 0.0f;
+  float v0_ = 0.0f;   // Plan start speed
+  float v1_ = 0.0f;   // Plan target speed
+  float dir_ = 1.0f;  // +1 speeding up, -1 slowing down
+  float B0_ = 0.0f;   // Start accel, in the direction of the change
+  float Ap_ = 0.0f;   // Peak accel reached
+  float T1_ = 0.0f;   // End of the first jerk phase
+  float T2_ = 0.0f;   // Constant-accel phase length
+  float T_ = 0.0f;    // Plan length
+  float t_ = 0.0f;    // Time into the plan
+  float v_ = 0.0f;    // Current setpoint
+};
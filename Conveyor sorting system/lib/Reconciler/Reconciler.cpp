@@ -0,0 +1,94 @@
+#include "Reconciler.h"
+
+void Reconciler::push(const PendingWeight& w) {
+  if (count_ == CAPACITY) {
+    // Keep the newest: the oldest is the most likely to be stale
+    head_ = (head_ + 1 == CAPACITY) ? 0 : head_ + 1;
+    count_--;
+    c_.overflow++;
+  }
+  size_t tail = head_ + count_;
+  if (tail >= CAPACITY) tail -= CAPACITY;
+  fifo_[tail] = w;
+  count_++;
+}
+
+bool Reconciler::onWeight(const PendingWeight& w) {
+  // Module 1 numbers from 1 after boot: a 1 that does not follow 0
+  // is a restart even if its HELLO was missed
+  if (w.seq == 1 && lastSeq_ != 0) haveSeq_ = false;
+
+  if (haveSeq_) {
+    uint16_t diff = (uint16_t)(w.seq - lastSeq_);
+    if (diff == 0 || diff >= 0x8000) {
+      c_.duplicates++;
+      return false;
+    }
+    if (diff > 1 && diff <= MAX_GAP) {
+      // Products of the first missing frames may already have passed
+      // as orphans; older orphans belong to no frame of this gap
+      if (orphanCredit_ && w.arrivalMs - lastOrphanMs_ > timeoutMs_) orphanCredit_ = 0;
+      uint16_t passed = (orphanCredit_ < diff - 1) ? orphanCredit_ : (uint16_t)(diff - 1);
+      c_.lostOrphaned += passed;
+      // One placeholder per remaining missing frame, in sequence order
+      for (uint16_t k = 1 + passed; k < diff; k++) {
+        PendingWeight ph = {};
+        ph.seq = (uint16_t)(lastSeq_ + k);
+        ph.lost = true;
+        ph.arrivalMs = w.arrivalMs;
+        push(ph);
+      }
+      c_.seqGaps += diff - 1;
+    } else if (diff > MAX_GAP) {
+      // Too many to be a few lost frames: count, but do not queue
+      c_.seqGaps += diff - 1;
+    }
+  }
+  haveSeq_ = true;
+  lastSeq_ = w.seq;
+  orphanCredit_ = 0;
+
+  PendingWeight e = w;
+  e.lost = false;
+  push(e);
+  c_.weights++;
+  return true;
+}
+
+size_t Reconciler::expire(uint32_t nowMs) {
+  size_t n = 0;
+  while (count_ > 0 && nowMs - fifo_[head_].arrivalMs > timeoutMs_) {
+    head_ = (head_ + 1 == CAPACITY) ? 0 : head_ + 1;
+    count_--;
+    n++;
+  }
+  c_.expired += n;
+  return n;
+}
+
+ReconResult Reconciler::onDetection(uint32_t nowMs, PendingWeight& out) {
+  expire(nowMs);
+  if (count_ == 0) {
+    c_.orphans++;
+    if (orphanCredit_ < MAX_GAP) orphanCredit_++;
+    lastOrphanMs_ = nowMs;
+    return RR_ORPHAN;
+  }
+  out = fifo_[head_];
+  head_ = (head_ + 1 == CAPACITY) ? 0 : head_ + 1;
+  count_--;
+  if (out.lost) {
+    c_.lostMatched++;
+    return RR_LOST_FRAME;
+  }
+  if (out.unverified) {
+    c_.unverified++;
+    return RR_UNVERIFIED;
+  }
+  c_.matched++;
+  return RR_MATCHED;
+}
+
+void Reconciler::clearCounters() {
+  c_ = {};
+}
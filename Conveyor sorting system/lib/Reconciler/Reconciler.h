@@ -0,0 +1,100 @@
+/************************************************************
+ * Reconciler - Match the weight stream with SR04 detections
+ *
+ * Weights (LM_WEIGHT, in Module 1 sequence order) wait in a
+ * fixed FIFO until the SR04 sees their product. Products reach
+ * the sensor in the same order they were weighed, so each
+ * detection takes the oldest pending weight.
+ *
+ * A gap in the sequence numbers means frames were lost: one
+ * placeholder per missing seq is queued, so the product that
+ * belongs to a lost frame is rejected instead of stealing the
+ * weight of the product behind it. Weights that are not claimed
+ * within the timeout are expired (product missed or removed),
+ * and a detection with nothing pending is an orphan. A weight
+ * sent as LM_UNVERIFIED takes its place in the FIFO like any
+ * other, but its product is reported RR_UNVERIFIED (rejected).
+ *
+ * A gap is only seen when the next frame arrives, which can be
+ * after the lost frame's product has already passed the sensor
+ * (as an orphan). Orphans since the last received weight are
+ * therefore counted, and that many of the gap's placeholders are
+ * dropped instead of queued - otherwise every later product would
+ * be matched one weight too late.
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct PendingWeight {
+  uint16_t seq;
+  bool     lost;          // Placeholder for a frame that never arrived
+  bool     unverified;    // LM_UNVERIFIED: weighed, estimate not trusted
+  int32_t  weightMg;
+  uint32_t arrivalMs;     // millis() when queued
+  uint32_t settleAgeUs;   // Latency tracing (see ProductTiming)
+  uint32_t rxUs;
+  uint32_t handlerUs;
+};
+
+struct ReconCounters {
+  uint32_t weights;       // LM_WEIGHT / LM_UNVERIFIED frames accepted
+  uint32_t matched;       // Detections sorted with their weight
+  uint32_t seqGaps;       // Frames missing from the sequence
+  uint32_t duplicates;    // Repeated/old seq, ignored
+  uint32_t expired;       // Pending entries never matched in time
+  uint32_t orphans;       // Detections with nothing pending
+  uint32_t lostMatched;   // Detections that hit a lost-frame placeholder
+  uint32_t unverified;    // Detections whose weight was LM_UNVERIFIED
+  uint32_t lostOrphaned;  // Lost frames whose product had already passed as an orphan
+  uint32_t overflow;      // Oldest entry dropped because the FIFO was full
+};
+
+enum ReconResult : uint8_t {
+  RR_MATCHED,     // `out` holds the product's weight
+  RR_LOST_FRAME,  // Product's weight frame was lost
+  RR_ORPHAN,      // Nothing pending
+  RR_UNVERIFIED,  // `out` holds a weight its sender did not trust
+};
+
+class Reconciler {
+public:
+  static const size_t CAPACITY = 16;
+  static const uint16_t MAX_GAP = 8;  // Larger jumps = sender restart
+
+  void setTimeoutMs(uint32_t ms) { timeoutMs_ = ms; }
+
+  // Module 1 (re)started: next seq starts a new sequence.
+  void resetSequence() {
+    haveSeq_ = false;
+    orphanCredit_ = 0;
+  }
+
+  // Returns false for duplicates / out-of-order frames.
+  bool onWeight(const PendingWeight& w);
+
+  // Drop entries older than the timeout. Returns how many.
+  size_t expire(uint32_t nowMs);
+
+  ReconResult onDetection(uint32_t nowMs, PendingWeight& out);
+
+  size_t pending() const { return count_; }
+  const ReconCounters& counters() const { return c_; }
+  void clearCounters();
+
+private:
+  void push(const PendingWeight& w);
+
+  PendingWeight fifo_[CAPACITY];
+  size_t head_ = 0;
+  size_t count_ = 0;
+  uint32_t timeoutMs_ = 15000;
+  uint16_t lastSeq_ = 0;
+  bool haveSeq_ = false;
+  uint16_t orphanCredit_ = 0;  // Orphans since the last received weight
+  uint32_t lastOrphanMs_ = 0;
+  ReconCounters c_ = {};
+};
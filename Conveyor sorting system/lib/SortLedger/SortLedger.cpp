@@ -0,0 +1,45 @@
+#include "SortLedger.h"
+
+#include <string.h>
+
+void SortLedger::attach(LedgerEntry* buf, size_t capacity) {
+  buf_ = buf;
+  cap_ = buf ? capacity : 0;
+  clear();
+}
+
+void SortLedger::clear() {
+  head_ = 0;
+  count_ = 0;
+  total_ = 0;
+}
+
+void SortLedger::append(const LedgerEntry& e) {
+  if (cap_ == 0) return;
+  buf_[head_] = e;
+  head_ = (head_ + 1 == cap_) ? 0 : head_ + 1;
+  total_++;
+  if (count_ < cap_) count_++;
+}
+
+size_t SortLedger::slot(uint64_t idx) const {
+  // back <= count_ <= cap_, so no 64-bit modulo on the hot path
+  size_t back = (size_t)(total_ - idx);
+  return (head_ >= back) ? head_ - back : head_ + cap_ - back;
+}
+
+bool SortLedger::get(uint64_t idx, LedgerEntry& out) const {
+  if (idx < firstIndex() || idx >= total_) {
+    memset(&out, 0, sizeof(out));
+    out.outcome = LO_LOST;
+    return false;
+  }
+  out = buf_[slot(idx)];
+  return true;
+}
+
+bool SortLedger::setOutcome(uint64_t idx, uint8_t outcome) {
+  if (idx < firstIndex() || idx >= total_) return false;
+  buf_[slot(idx)].outcome = outcome;
+  return true;
+}
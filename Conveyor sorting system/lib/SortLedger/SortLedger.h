@@ -0,0 +1,72 @@
+/************************************************************
+ * SortLedger - Per-product traceability ring buffer
+ *
+ * One packed 18-byte entry per sorted product (sequence id,
+ * weight, bin, detect/divert time, outcome). Storage is provided
+ * by the caller (PSRAM on the ESP32-S3) and append is O(1); the
+ * oldest entries are overwritten once the ring is full.
+ *
+ * Entries are addressed by an absolute index that keeps counting
+ * across wrap-around, so a dump that started before new products
+ * were appended still knows which of its entries were overwritten
+ * meanwhile (those come back with outcome LO_LOST). The outcome
+ * of a recent entry can still be changed (setOutcome), e.g. when
+ * its diverter hold is cut short by the next product.
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Outcome codes. Keep the numbering stable: dumps are decoded offline.
+enum LedgerOutcome : uint8_t {
+  LO_LOST              = 0,  // Entry overwritten before it could be dumped
+  LO_SORTED_LINK       = 1,  // Sorted with a weight received over ESP-NOW
+  LO_SORTED_MANUAL     = 2,  // Sorted with the manual (WEIGHT button) value
+  LO_REJECT_NO_WEIGHT  = 3,  // No pending weight: sent to the reject bin
+  LO_REJECT_LOST_FRAME = 4,  // Its weight frame was lost: sent to the reject bin
+  LO_UNVERIFIED_PREEMPTED = 5,  // Diverter released early for the next product: bin not guaranteed
+  LO_REJECT_UNVERIFIED = 6,  // Weight sent as LM_UNVERIFIED: sent to the reject bin
+};
+
+struct __attribute__((packed)) LedgerEntry {
+  uint32_t seq;        // Product sequence id (productCount)
+  int32_t  weightMg;   // Weight used for sorting (or the untrusted one), milligrams
+  uint32_t detectMs;   // millis() when SR04 detected the product
+  uint32_t divertMs;   // millis() when the diverter was actuated
+  uint8_t  bin;        // 1..3
+  uint8_t  outcome;    // LedgerOutcome
+};
+
+static_assert(sizeof(LedgerEntry) == 18, "LedgerEntry must stay 18 bytes");
+
+class SortLedger {
+public:
+  void attach(LedgerEntry* buf, size_t capacity);
+  void clear();
+
+  // O(1), overwrites the oldest entry when full.
+  void append(const LedgerEntry& e);
+
+  size_t size() const { return count_; }
+  size_t capacity() const { return cap_; }
+  uint64_t total() const { return total_; }          // Entries ever appended
+  uint64_t firstIndex() const { return total_ - count_; }
+
+  // Copies the entry with absolute index `idx`. Returns false (and a
+  // LO_LOST entry) if it has been overwritten or not yet written.
+  bool get(uint64_t idx, LedgerEntry& out) const;
+  // False if the entry has been overwritten or not yet written.
+  bool setOutcome(uint64_t idx, uint8_t outcome);
+
+private:
+  size_t slot(uint64_t idx) const;  // idx must be in the buffer
+
+  LedgerEntry* buf_ = nullptr;
+  size_t cap_ = 0;
+  size_t head_ = 0;   // Next write slot
+  size_t count_ = 0;
+  uint64_t total_ = 0;
+};
@@ -0,0 +1,144 @@
+#include "SortStats.h"
+
+#include <math.h>
+
+// ---------------- RunningStats ----------------
+
+void RunningStats::add(double x) {
+  n_++;
+  if (n_ == 1) {
+    mean_ = x;
+    m2_ = 0.0;
+    min_ = max_ = x;
+    return;
+  }
+  // Welford: no catastrophic cancellation, unlike sum / sum of squares
+  double delta = x - mean_;
+  mean_ += delta / n_;
+  m2_ += delta * (x - mean_);
+  if (x < min_) min_ = x;
+  if (x > max_) max_ = x;
+}
+
+void RunningStats::clear() {
+  *this = RunningStats();
+}
+
+double RunningStats::variance() const {
+  return (n_ < 2) ? 0.0 : m2_ / (n_ - 1);
+}
+
+double RunningStats::stddev() const {
+  return sqrt(variance());
+}
+
+// ---------------- Histogram ----------------
+
+void Histogram::configure(double lo, double hi) {
+  lo_ = lo;
+  hi_ = (hi > lo) ? hi : lo + 1.0;
+  width_ = (hi_ - lo_) / BUCKETS;
+  clear();
+}
+
+void Histogram::add(double x) {
+  if (x < lo_) {
+    under_++;
+  } else if (x >= hi_) {
+    over_++;
+  } else {
+    size_t i = (size_t)((x - lo_) / width_);
+    if (i >= BUCKETS) i = BUCKETS - 1;  // Rounding at the top edge
+    counts_[i]++;
+  }
+}
+
+void Histogram::clear() {
+  for (size_t i = 0; i < BUCKETS; i++) counts_[i] = 0;
+  under_ = over_ = 0;
+}
+
+// ---------------- RateWindow ----------------
+
+void RateWindow::begin(uint32_t slotMs) {
+  slotMs_ = slotMs ? slotMs : 1;
+  clear();
+}
+
+void RateWindow::clear() {
+  for (size_t i = 0; i < SLOTS; i++) slots_[i] = 0;
+  sum_ = 0;
+  cur_ = 0;
+  started_ = false;
+}
+
+// Move the current slot up to nowMs, zeroing the slots that left the window
+void RateWindow::advance(uint32_t nowMs) {
+  if (!started_) {
+    started_ = true;
+    slotStart_ = nowMs;
+    return;
+  }
+  if ((int32_t)(nowMs - slotStart_) < 0) return;  // Stale timestamp
+  uint32_t steps = (nowMs - slotStart_) / slotMs_;
+  if (steps == 0) return;
+  if (steps >= SLOTS) {
+    for (size_t i = 0; i < SLOTS; i++) slots_[i] = 0;
+    sum_ = 0;
+  } else {
+    for (uint32_t k = 0; k < steps; k++) {
+      cur_ = (cur_ + 1 == SLOTS) ? 0 : cur_ + 1;
+      sum_ -= slots_[cur_];
+      slots_[cur_] = 0;
+    }
+  }
+  slotStart_ += steps * slotMs_;
+}
+
+void RateWindow::add(uint32_t nowMs) {
+  advance(nowMs);
+  slots_[cur_]++;
+  sum_++;
+}
+
+uint32_t RateWindow::count(uint32_t nowMs) {
+  advance(nowMs);
+  return sum_;
+}
+
+// ---------------- SortStats ----------------
+
+void SortStats::begin() {
+  minute_.begin(1000);       // 60 x 1 s
+  tenMinutes_.begin(10000);  // 60 x 10 s
+  clear();
+}
+
+void SortStats::clear() {
+  for (int b = 0; b < BINS; b++) {
+    stats_[b].clear();
+    hist_[b].clear();
+  }
+  minute_.clear();
+  tenMinutes_.clear();
+  rejected_ = 0;
+}
+
+void SortStats::configureBin(int bin, double lo, double hi) {
+  if (bin < 1 || bin > BINS) return;
+  hist_[bin - 1].configure(lo, hi);
+}
+
+void SortStats::addSorted(int bin, double grams, uint32_t nowMs) {
+  minute_.add(nowMs);
+  tenMinutes_.add(nowMs);
+  if (bin < 1 || bin > BINS) return;
+  stats_[bin - 1].add(grams);
+  hist_[bin - 1].add(grams);
+}
+
+void SortStats::addRejected(uint32_t nowMs) {
+  minute_.add(nowMs);
+  tenMinutes_.add(nowMs);
+  rejected_++;
+}
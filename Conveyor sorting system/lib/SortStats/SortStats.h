@@ -0,0 +1,116 @@
+/************************************************************
+ * SortStats - Running per-bin statistics for the sort path
+ *
+ * Everything is updated in O(1) per product with fixed memory,
+ * so the LCD and the serial "stats" command never scan history:
+ *   RunningStats  count / mean / variance (Welford) / min / max
+ *   Histogram     fixed buckets over [lo, hi) + under/over
+ *   RateWindow    items per window from a ring of time slots
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class RunningStats {
+public:
+  void add(double x);
+  void clear();
+
+  uint32_t count() const { return n_; }
+  double mean() const { return mean_; }
+  double variance() const;  // Sample variance (n - 1), 0 below 2 samples
+  double stddev() const;
+  double min() const { return min_; }
+  double max() const { return max_; }
+
+private:
+  uint32_t n_ = 0;
+  double mean_ = 0.0;
+  double m2_ = 0.0;  // Sum of squared deviations from the mean
+  double min_ = 0.0;
+  double max_ = 0.0;
+};
+
+class Histogram {
+public:
+  static const size_t BUCKETS = 10;
+
+  // Clears the counts.
+  void configure(double lo, double hi);
+  void add(double x);
+  void clear();
+
+  double lo() const { return lo_; }
+  double hi() const { return hi_; }
+  double bucketLo(size_t i) const { return lo_ + i * width_; }
+  uint32_t bucket(size_t i) const { return counts_[i]; }
+  uint32_t under() const { return under_; }
+  uint32_t over() const { return over_; }
+
+private:
+  double lo_ = 0.0;
+  double hi_ = 1.0;
+  double width_ = 0.1;
+  uint32_t counts_[BUCKETS] = {};
+  uint32_t under_ = 0;
+  uint32_t over_ = 0;
+};
+
+class RateWindow {
+public:
+  static const size_t SLOTS = 60;
+
+  // Window = SLOTS * slotMs (e.g. 60 x 1 s = items/min). Clears.
+  void begin(uint32_t slotMs);
+  void add(uint32_t nowMs);
+  void clear();
+
+  // Items in the last full window (the current slot included).
+  uint32_t count(uint32_t nowMs);
+  uint32_t windowMs() const { return slotMs_ * SLOTS; }
+
+private:
+  void advance(uint32_t nowMs);
+
+  uint32_t slotMs_ = 1000;
+  uint32_t slotStart_ = 0;  // Start time of the current slot
+  size_t cur_ = 0;
+  bool started_ = false;
+  uint32_t slots_[SLOTS] = {};
+  uint32_t sum_ = 0;
+};
+
+// Per-bin weight statistics plus throughput, fed by the sort path.
+class SortStats {
+public:
+  static const int BINS = 3;
+
+  void begin();
+  void clear();
+
+  // Histogram ranges; bins 1..3 (clears the histograms).
+  void configureBin(int bin, double lo, double hi);
+
+  // Sorted with a known weight (grams).
+  void addSorted(int bin, double grams, uint32_t nowMs);
+  // Rejected (no verified weight): counted in rates only.
+  void addRejected(uint32_t nowMs);
+
+  const RunningStats& stats(int bin) const { return stats_[bin - 1]; }
+  const Histogram& histogram(int bin) const { return hist_[bin - 1]; }
+  uint32_t rejected() const { return rejected_; }
+
+  uint32_t perMinute(uint32_t nowMs) { return minute_.count(nowMs); }
+  // Items/min averaged over the last 10 minutes
+  uint32_t perMinute10(uint32_t nowMs) { return tenMinutes_.count(nowMs) / 10; }
+
+private:
+  RunningStats stats_[BINS];
+  Histogram hist_[BINS];
+  RateWindow minute_;
+  RateWindow tenMinutes_;
+  uint32_t rejected_ = 0;
+};
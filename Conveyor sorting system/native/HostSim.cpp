@@ -0,0 +1,130 @@
+#include "HostSim.h"
+
+#include <Arduino.h>
+#include <FastAccelStepper.h>
+
+#define HOST_STEP_US 1000  // Stepper model resolution
+#define HOST_PINS 64
+
+HostSerial Serial;
+
+static uint64_t s_nowUs = 0;
+static int s_pins[HOST_PINS];
+static bool s_pinsSet = false;
+static HostEchoFn s_echo = nullptr;
+static void* s_echoCtx = nullptr;
+static std::string s_in;
+static size_t s_inPos = 0;
+static std::string s_out;
+static bool s_echoOut = false;
+static HostStepperProbe s_probe = nullptr;
+
+// ---------------- Host control ----------------
+
+uint64_t hostNowUs() { return s_nowUs; }
+
+void hostAdvanceUs(uint64_t us) {
+  while (us > 0) {
+    uint64_t step = us < HOST_STEP_US ? us : HOST_STEP_US;
+    s_nowUs += step;
+    us -= step;
+    if (hostStepper) {
+      hostStepper->hostAdvance(step * 1e-6);
+      if (s_probe) s_probe(s_nowUs, hostStepper->getCurrentSpeedInMilliHz() / 1000.0);
+    }
+  }
+}
+
+void hostAdvanceToUs(uint64_t tUs) {
+  if (tUs > s_nowUs) hostAdvanceUs(tUs - s_nowUs);
+}
+
+static void initPins() {
+  if (s_pinsSet) return;
+  for (int i = 0; i < HOST_PINS; i++) s_pins[i] = HIGH;
+  s_pinsSet = true;
+}
+
+void hostSetPin(uint8_t pin, int level) {
+  initPins();
+  if (pin < HOST_PINS) s_pins[pin] = level ? HIGH : LOW;
+}
+
+void hostSetEcho(HostEchoFn fn, void* ctx) {
+  s_echo = fn;
+  s_echoCtx = ctx;
+}
+
+void hostSerialInput(const char* text) { s_in += text; }
+std::string& hostSerialOutput() { return s_out; }
+void hostSerialEcho(bool toStdout) { s_echoOut = toStdout; }
+void hostSetStepperProbe(HostStepperProbe fn) { s_probe = fn; }
+
+// ---------------- Arduino API ----------------
+
+uint32_t millis() { return (uint32_t)(s_nowUs / 1000); }
+uint32_t micros() { return (uint32_t)s_nowUs; }
+void delay(uint32_t ms) { hostAdvanceUs((uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us) { hostAdvanceUs(us); }
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+  initPins();
+}
+
+int digitalRead(uint8_t pin) {
+  initPins();
+  return pin < HOST_PINS ? s_pins[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) { hostSetPin(pin, level); }
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeoutUs) {
+  (void)pin;
+  (void)state;
+  if (s_echo) return s_echo(s_echoCtx);
+  hostAdvanceUs(timeoutUs);
+  return 0;
+}
+
+bool psramFound() { return false; }
+void* ps_malloc(size_t n) { return malloc(n); }
+
+// ---------------- Print / Serial ----------------
+
+size_t Print::print(long v, int base) {
+  if (base == DEC) return printf("%ld", v);
+  return print((unsigned long)v, base);
+}
+
+size_t Print::print(unsigned long v, int base) {
+  return printf(base == HEX ? "%lX" : "%lu", v);
+}
+
+size_t Print::print(double v, int digits) { return printf("%.*f", digits, v); }
+
+size_t Print::printf(const char* fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n < 0) return 0;
+  return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+int HostSerial::available() { return (int)(s_in.size() - s_inPos); }
+
+int HostSerial::read() {
+  if (s_inPos >= s_in.size()) return -1;
+  return (uint8_t)s_in[s_inPos++];
+}
+
+int HostSerial::availableForWrite() { return 4096; }
+
+size_t HostSerial::write(const uint8_t* p, size_t n) {
+  s_out.append((const char*)p, n);
+  if (s_echoOut) fwrite(p, 1, n, stdout);
+  return n;
+}
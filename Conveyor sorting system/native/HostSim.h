@@ -0,0 +1,37 @@
+/************************************************************
+ * HostSim - Virtual hardware behind native/stubs
+ *
+ * src/main.cpp builds unchanged for the host (env:native). Time
+ * is virtual: it moves only when the firmware waits (delay(),
+ * pulseIn()) or the host advances it, so a run does not depend
+ * on the speed of the PC and repeats exactly.
+ *
+ *   pins     digitalRead() levels, HIGH until set (pull-ups)
+ *   echo     pulseIn() source; without one it times out
+ *   serial   input queued for Serial.read(), output captured
+ *   stepper  FastAccelStepper model, advanced with the clock
+ ************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Virtual time since start, in microseconds (micros() is the low 32 bits)
+uint64_t hostNowUs();
+void hostAdvanceUs(uint64_t us);
+void hostAdvanceToUs(uint64_t tUs);  // No-op if already past
+
+void hostSetPin(uint8_t pin, int level);
+
+// Called by pulseIn(): returns the echo time in us (0 = no echo) and
+// advances the clock itself.
+typedef unsigned long (*HostEchoFn)(void* ctx);
+void hostSetEcho(HostEchoFn fn, void* ctx);
+
+void hostSerialInput(const char* text);
+std::string& hostSerialOutput();      // Everything written so far
+void hostSerialEcho(bool toStdout);   // Also copy output to stdout
+
+// Called every simulated millisecond with the stepper rate (steps/s)
+typedef void (*HostStepperProbe)(uint64_t tUs, double hz);
+void hostSetStepperProbe(HostStepperProbe fn);
@@ -0,0 +1,82 @@
+#include "TraceReplay.h"
+
+#include <Arduino.h>
+#include <math.h>
+
+#include "HostSim.h"
+#include "NowLink.h"
+
+extern EspNowLink nowLink;  // src/main.cpp
+
+void TraceReplay::begin(const TraceRecord* recs, size_t n) {
+  static bool started = false;
+  if (!started) {
+    setup();  // Once per process: main.cpp globals are not re-initialised
+    started = true;
+  }
+  cur_ = TraceCursor(recs, n);
+  baseUs_ = hostNowUs();
+  lastSeq_ = 0;
+  loops_ = 0;
+  hostSetEcho(echo, this);
+}
+
+bool TraceReplay::step() {
+  applyUntilSensor();
+  if (cur_.done()) return false;
+  loop();
+  loops_++;
+  return true;
+}
+
+void TraceReplay::advanceToNext() {
+  hostAdvanceToUs(baseUs_ + cur_.nextTimeUs());
+}
+
+// Inputs recorded between two SR04 reads happened during one pass
+void TraceReplay::applyUntilSensor() {
+  const TraceRecord* r;
+  while ((r = cur_.peek()) && r->kind != TR_SR04) {
+    advanceToNext();
+    TraceRecord rec = *r;
+    cur_.skip();
+    if (rec.kind == TR_BUTTON) {
+      hostSetPin(rec.arg, rec.value);
+    } else if (rec.kind == TR_NOW_RX) {
+      applyFrame(rec);
+    }
+    // TR_NOW_TX / TR_MARK are outputs of the recorded run
+  }
+}
+
+void TraceReplay::applyFrame(const TraceRecord& r) {
+  LinkRx rx = {};
+  rx.msg.magic = LINK_MAGIC;
+  rx.msg.type = r.arg;
+  rx.msg.value = r.value;
+  const TraceRecord* s = cur_.peek();
+  if (s && s->kind == TR_NOW_SEQ && s->arg == r.arg) {
+    rx.msg.seq = (uint16_t)s->value;
+    cur_.skip();
+  } else {
+    rx.msg.seq = (r.arg == LM_HELLO) ? 0 : (uint16_t)(lastSeq_ + 1);  // Older trace: no gaps
+  }
+  if (r.arg == LM_HELLO) lastSeq_ = 0;
+  if (r.arg == LM_WEIGHT || r.arg == LM_UNVERIFIED) lastSeq_ = rx.msg.seq;
+  rx.msg.txUs = micros();
+  rx.rxUs = micros();
+  nowLink.inject(rx);
+}
+
+// pulseIn(): the next record is this pass's SR04 reading
+unsigned long TraceReplay::echo(void* ctx) {
+  TraceReplay* self = (TraceReplay*)ctx;
+  const TraceRecord* r = self->cur_.peek();
+  if (!r || r->kind != TR_SR04) return 0;
+  self->advanceToNext();
+  int32_t v = r->value;
+  self->cur_.skip();
+  if (v < 0) return 0;
+  // Inverse of readDistance_mm(): value = (int)(dur * 0.1715 * 10)
+  return (unsigned long)ceil(v / 1.715 - 1e-6);
+}
@@ -0,0 +1,43 @@
+/************************************************************
+ * TraceReplay - Feed a recorded trace back into loop()
+ *
+ * Drives the native build of src/main.cpp with the inputs a
+ * real run recorded ('r' then 'd' on Module 2): button edges,
+ * ESP-NOW frames and SR04 readings. loop() reads the SR04 once
+ * per pass, so each TR_SR04 record stands for one pass:
+ *
+ *   1. records before it (buttons, frames) are applied at their
+ *      recorded time,
+ *   2. loop() runs; its pulseIn() returns the recorded echo and
+ *      the clock moves to the record's time.
+ *
+ * The ledger, reconciler counters and stats then show what the
+ * current firmware makes of the same run.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TraceCapture.h"
+#include "TraceLog.h"
+
+class TraceReplay {
+public:
+  // recs must stay valid during the replay. Runs setup() on the first call.
+  void begin(const TraceRecord* recs, size_t n);
+  // One loop() pass. False when no SR04 reading is left.
+  bool step();
+  uint32_t loops() const { return loops_; }
+
+private:
+  static unsigned long echo(void* ctx);
+  void applyUntilSensor();
+  void applyFrame(const TraceRecord& r);
+  void advanceToNext();  // Clock to the next record's time
+
+  TraceCursor cur_{nullptr, 0};
+  uint64_t baseUs_ = 0;    // Virtual time of the first record
+  uint16_t lastSeq_ = 0;   // For traces recorded without TR_NOW_SEQ
+  uint32_t loops_ = 0;
+};
@@ -0,0 +1,96 @@
+/************************************************************
+ * Trace replay tool (env:native)
+ *
+ *   pio run -e native
+ *   .pio/build/native/program capture.bin [-v] [-c "set BIN1_MAX_G 60"]...
+ *
+ * capture.bin is the raw serial capture of a 'd' dump (see
+ * tools/dump_to_csv.py). -c queues a serial command before the
+ * replay starts, -v shows the firmware's serial output. Prints
+ * the resulting ledger as CSV (same columns as dump_to_csv.py),
+ * then the firmware's own recon and stats reports.
+ ************************************************************/
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "HostSim.h"
+#include "SortLedger.h"
+#include "TraceReplay.h"
+
+extern SortLedger sortLedger;  // src/main.cpp
+
+// LedgerOutcome names, as in tools/dump_to_csv.py
+static const char* const OUTCOMES[] = {"lost", "sorted_link", "sorted_manual", "reject_no_weight",
+                                       "reject_lost_frame", "unverified_preempted",
+                                       "reject_unverified"};
+
+static void usage() {
+  fprintf(stderr, "usage: program capture.bin [-v] [-c command]...\n");
+}
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  bool verbose = false;
+  std::string commands;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      commands += argv[++i];
+      commands += '\n';
+    } else if (!path) {
+      path = argv[i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (!path) {
+    usage();
+    return 2;
+  }
+
+  std::vector<TraceRecord> recs;
+  if (!loadTraceCapture(path, recs)) {
+    fprintf(stderr, "%s: no complete TRACE block\n", path);
+    return 1;
+  }
+  fprintf(stderr, "%u records\n", (unsigned)recs.size());
+
+  hostSerialEcho(verbose);
+  TraceReplay replay;
+  replay.begin(recs.data(), recs.size());
+  hostSerialInput(commands.c_str());
+  while (replay.step()) {
+    if (!verbose) hostSerialOutput().clear();  // Long traces: keep memory flat
+  }
+  fprintf(stderr, "%u loop() passes, %.1f s simulated\n", (unsigned)replay.loops(),
+          hostNowUs() / 1e6);
+
+  printf("seq,weight_g,bin,detect_ms,divert_ms,outcome\n");
+  for (uint64_t i = sortLedger.firstIndex(); i < sortLedger.total(); i++) {
+    LedgerEntry e;
+    sortLedger.get(i, e);
+    printf("%u,%.3f,%u,%u,%u,", (unsigned)e.seq, e.weightMg / 1000.0, (unsigned)e.bin,
+           (unsigned)e.detectMs, (unsigned)e.divertMs);
+    if (e.outcome < sizeof(OUTCOMES) / sizeof(OUTCOMES[0])) {
+      printf("%s\n", OUTCOMES[e.outcome]);
+    } else {
+      printf("%u\n", (unsigned)e.outcome);
+    }
+  }
+
+  // Reports from the firmware itself
+  hostSerialOutput().clear();
+  hostSerialInput("recon\nstats\n");
+  loop();
+  fputs(hostSerialOutput().c_str(), stdout);
+  return 0;
+}
+
+#endif  // PIO_UNIT_TESTING
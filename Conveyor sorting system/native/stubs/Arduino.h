@@ -0,0 +1,76 @@
+/************************************************************
+ * Arduino.h - Host stand-in for the native env
+ *
+ * Only what src/main.cpp uses. Time, pins, the SR04 echo and
+ * the serial port are simulated in native/HostSim.cpp.
+ ************************************************************/
+#pragma once
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define DEC 10
+#define HEX 16
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t level);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeoutUs = 1000000UL);
+
+bool psramFound();
+void* ps_malloc(size_t n);
+
+// Formatted output on top of write(), like the core's Print.
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t* p, size_t n) = 0;
+  size_t write(uint8_t c) { return write(&c, 1); }
+
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int digits = 2);
+  size_t println() { return print("\r\n"); }
+  template <class T> size_t println(T v) { return print(v) + println(); }
+  template <class T> size_t println(T v, int f) { return print(v, f) + println(); }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Serial port: input queued by the host, output captured (HostSim.h).
+class HostSerial : public Print {
+public:
+  using Print::write;
+  void begin(unsigned long baud) { (void)baud; }
+  size_t setTxBufferSize(size_t n) { return n; }
+  int available();
+  int read();
+  int availableForWrite();
+  size_t write(const uint8_t* p, size_t n) override;
+  void flush() {}
+};
+
+extern HostSerial Serial;
+
+// Firmware entry points (src/main.cpp)
+void setup();
+void loop();
@@ -0,0 +1,15 @@
+// ESP32Servo.h - Host stand-in, keeps the last angle for tests.
+#pragma once
+
+#include <Arduino.h>
+
+class Servo {
+public:
+  int attach(int pin) { pin_ = pin; return 1; }
+  void write(int angle) { angle_ = angle; }
+  int read() const { return angle_; }
+
+private:
+  int pin_ = -1;
+  int angle_ = 0;
+};
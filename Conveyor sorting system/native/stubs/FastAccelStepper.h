@@ -0,0 +1,100 @@
+/************************************************************
+ * FastAccelStepper.h - Host stand-in with a speed model
+ *
+ * Like the library's ramp generator: the step rate moves toward
+ * the set speed at the set acceleration (linear ramp) and the
+ * position is the integral of it. HostSim advances the model
+ * together with the virtual clock.
+ ************************************************************/
+#pragma once
+
+#include <Arduino.h>
+
+class FastAccelStepper {
+public:
+  void setDirectionPin(uint8_t pin, bool dirHighCountsUp = true, uint16_t delayUs = 0) {
+    (void)pin; (void)dirHighCountsUp; (void)delayUs;
+  }
+  void setEnablePin(uint8_t pin, bool lowActive = true) { (void)pin; (void)lowActive; }
+  void setAutoEnable(bool on) { (void)on; }
+
+  // Taken over by the next run*() or applySpeedAcceleration()
+  int8_t setSpeedInHz(uint32_t hz) {
+    if (hz == 0) return -1;
+    cfgHz_ = hz;
+    return 0;
+  }
+  int8_t setAcceleration(int32_t a) {
+    if (a <= 0) return -1;
+    cfgAccel_ = a;
+    return 0;
+  }
+  int8_t runForward() { return run(1); }
+  int8_t runBackward() { return run(-1); }
+  void applySpeedAcceleration() {
+    if (!running_ || stopping_) return;
+    targetHz_ = cfgHz_;
+    accel_ = cfgAccel_;
+  }
+  void stopMove() {
+    if (!running_) return;
+    stopping_ = true;
+    targetHz_ = 0;
+    accel_ = cfgAccel_;
+  }
+
+  bool isRunning() const { return running_; }
+  int32_t getCurrentPosition() const { return (int32_t)lround(pos_); }
+  int32_t getCurrentSpeedInMilliHz() const { return (int32_t)lround(dir_ * hz_ * 1000.0); }
+  int32_t acceleration() const { return accel_; }  // Host only: ramp now in use
+
+  // Host only: move the model forward by dtS seconds.
+  void hostAdvance(double dtS) {
+    if (!running_) return;
+    double dv = targetHz_ - hz_;
+    double lim = accel_ * dtS;
+    double v0 = hz_;
+    hz_ += dv > lim ? lim : (dv < -lim ? -lim : dv);
+    pos_ += dir_ * 0.5 * (v0 + hz_) * dtS;
+    if (stopping_ && hz_ <= 0) {
+      hz_ = 0;
+      running_ = false;
+      stopping_ = false;
+    }
+  }
+
+private:
+  int8_t run(int dir) {
+    if (running_ && dir != dir_ && hz_ > 0) return -1;  // Must stop first
+    dir_ = dir;
+    running_ = true;
+    stopping_ = false;
+    targetHz_ = cfgHz_;
+    accel_ = cfgAccel_;
+    return 0;
+  }
+
+  uint32_t cfgHz_ = 0;
+  int32_t cfgAccel_ = 0;
+  double targetHz_ = 0;
+  int32_t accel_ = 0;
+  double hz_ = 0;
+  double pos_ = 0;
+  int dir_ = 1;
+  bool running_ = false;
+  bool stopping_ = false;
+};
+
+// The firmware drives a single stepper; HostSim finds it here.
+inline FastAccelStepper* hostStepper = nullptr;
+
+class FastAccelStepperEngine {
+public:
+  void init() {}
+  FastAccelStepper* stepperConnectToPin(uint8_t stepPin) {
+    (void)stepPin;
+    static FastAccelStepper s;
+    hostStepper = &s;
+    return &s;
+  }
+};
@@ -0,0 +1,44 @@
+// LiquidCrystal_I2C.h - Host stand-in: keeps the visible 16x2 text so
+// tests can read what the operator would see.
+#pragma once
+
+#include <Arduino.h>
+#include <string.h>
+
+class LiquidCrystal_I2C : public Print {
+public:
+  static const uint8_t COLS = 16;
+  static const uint8_t ROWS = 2;
+
+  LiquidCrystal_I2C(uint8_t addr, uint8_t cols, uint8_t rows) {
+    (void)addr; (void)cols; (void)rows;
+    clear();
+  }
+  void init() {}
+  void begin(uint8_t cols, uint8_t rows) { (void)cols; (void)rows; }
+  void backlight() {}
+  void clear() {
+    for (uint8_t r = 0; r < ROWS; r++) {
+      memset(text_[r], ' ', COLS);
+      text_[r][COLS] = '\0';
+    }
+    col_ = row_ = 0;
+  }
+  void setCursor(uint8_t col, uint8_t row) {
+    col_ = col;
+    row_ = row < ROWS ? row : ROWS - 1;
+  }
+  // Past column 16 the text goes off screen, as on the real display
+  size_t write(const uint8_t* p, size_t n) override {
+    for (size_t i = 0; i < n; i++, col_++) {
+      if (col_ < COLS) text_[row_][col_] = (char)p[i];
+    }
+    return n;
+  }
+  const char* line(uint8_t row) const { return text_[row]; }
+
+private:
+  char text_[ROWS][COLS + 1];
+  uint8_t col_ = 0;
+  uint8_t row_ = 0;
+};
@@ -0,0 +1,25 @@
+// Preferences.h - Host stand-in: in-memory NVS, empty at start.
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+class Preferences {
+public:
+  bool begin(const char* ns, bool readOnly = false) { ns_ = ns; (void)readOnly; return true; }
+  void end() {}
+  bool isKey(const char* key) { return store().count(k(key)) != 0; }
+  float getFloat(const char* key, float def = 0) { return isKey(key) ? store()[k(key)] : def; }
+  int32_t getInt(const char* key, int32_t def = 0) { return isKey(key) ? (int32_t)store()[k(key)] : def; }
+  size_t putFloat(const char* key, float v) { store()[k(key)] = v; return 4; }
+  size_t putInt(const char* key, int32_t v) { store()[k(key)] = (double)v; return 4; }
+
+private:
+  static std::map<std::string, double>& store() {
+    static std::map<std::string, double> s;
+    return s;
+  }
+  std::string k(const char* key) const { return ns_ + "/" + key; }
+  std::string ns_;
+};
@@ -0,0 +1,20 @@
+// WiFi.h - Host stand-in: STA is up at once, fixed MAC.
+#pragma once
+
+#include <Arduino.h>
+
+#define WIFI_STA 1
+
+struct HostWiFiSta {
+  bool started() const { return true; }
+};
+
+class HostWiFi {
+public:
+  bool mode(int m) { (void)m; return true; }
+  bool setChannel(uint8_t ch) { (void)ch; return true; }
+  const char* macAddress() const { return "00:00:00:00:00:00"; }
+  HostWiFiSta STA;
+};
+
+inline HostWiFi WiFi;
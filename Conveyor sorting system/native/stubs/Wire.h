@@ -0,0 +1,17 @@
+// Wire.h - Host stand-in: one device (the LCD) answers at 0x27.
+#pragma once
+
+#include <Arduino.h>
+
+class TwoWire {
+public:
+  bool begin(int sda, int scl) { (void)sda; (void)scl; return true; }
+  void setClock(uint32_t hz) { (void)hz; }
+  void beginTransmission(uint8_t addr) { addr_ = addr; }
+  uint8_t endTransmission() { return addr_ == 0x27 ? 0 : 2; }  // 2 = NACK on address
+
+private:
+  uint8_t addr_ = 0;
+};
+
+inline TwoWire Wire;
@@ -1,22 +1,38 @@
 /************************************************************
  * ESP32-S3 + TMC2209 - Conveyor with Product Sorting System
- * MODULE 2: Băng chuyền phân loại (ESP-NOW Serial Receiver)
+ * MODULE 2: Băng chuyền phân loại (ESP-NOW Receiver)
  * Module 1 MAC: 20:E7:C8:67:39:70 (ESP32)
  * Module 2 MAC: 10:20:BA:49:CD:D0 (ESP32-S3)
- * START: Chạy băng chuyền
- * STOP: Dừng băng chuyền
- * WEIGHT: Tăng/giảm khối lượng thủ công (test mode)
- * Sorting Logic (nhận từ Module 1 qua ESP-NOW Serial):
- *   Format: "Khoi_luong:XXX.XXXg"
+ * START: Chạy băng chuyền (tăng tốc S-curve)
+ * STOP: Dừng băng chuyền (giảm tốc S-curve, giữ vị trí step)
+ * WEIGHT: Tăng/giảm khối lượng thủ công (test mode, cần MANUAL_WEIGHT=1)
+ * Sorting Logic (nhận từ Module 1 qua ESP-NOW):
+ *   Format: LinkMsg LM_WEIGHT (16 bytes, value = weight in mg), see NowLink.h
+ *   Mỗi sản phẩm SR04 phát hiện lấy khối lượng cũ nhất đang chờ (FIFO theo seq).
+ *   Mất frame / không có khối lượng -> REJECT_BIN (mặc định bin 3), không đoán.
+ *   LM_UNVERIFIED (cân động không đủ tin cậy, vẫn giữ seq) -> REJECT_BIN.
  *   0-50g: Servo1 @ 70° (bin 1)
  *   50-200g: Servo1 @ 0°, Servo2 @ 115° (bin 2)
  *   200-1000g: Both @ home position (bin 3 - end of conveyor)
+ *   BATCH_MODE=1: đóng gói theo khối lượng mục tiêu BATCH_TARGET_G thay vì
+ *   theo khoảng (các bin khác REJECT_BIN), xem BatchPacker.h
  * Pins:
  *   TMC2209: DIR=12, STEP=13, EN=14
  *   Buttons: START=4, STOP=5, WEIGHT=6
  *   LCD I2C: SDA=38, SCL=39
  *   SR04: TRIG=1, ECHO=2
  *   Servos: SERVO1=36, SERVO2=45
+ * Serial commands (USB, one per line, "help" for the list):
+ *   list | get NAME | set NAME VALUE | defaults | save | load
+ *     (set is applied between two products, save writes to NVS;
+ *      staged values that break BIN1_MAX_G < BIN2_MAX_G are all dropped)
+ *   link: ESP-NOW counters | lat [clear]: per-stage latency p50/p95/p99
+ *   recon [clear]: weight/detection reconciliation counters
+ *   stats [clear]: per-bin count/mean/sd/min/max, histograms, items/min
+ *   pack [clear | empty N]: batching fills, packs and giveaway
+ *   r: Bat/tat ghi trace (SR04, buttons, ESP-NOW RX)
+ *   d: Dump trace (binary, framed: DumpFrame.h) | c: Xoa trace
+ *   l: Dump sort ledger (binary, 18 bytes/product, framed like the trace)
  ************************************************************/
 #include <Arduino.h>
 #include <FastAccelStepper.h>
@@ -24,8 +40,17 @@
 #include <LiquidCrystal_I2C.h>
 #include <ESP32Servo.h>
 #include <WiFi.h>
-#include "ESP32_NOW_Serial.h"
-#include "MacAddress.h"
+#include <Preferences.h>
+#include "TraceLog.h"
+#include "DumpFrame.h"
+#include "SortLedger.h"
+#include "ParamRegistry.h"
+#include "NowLink.h"
+#include "StageLatency.h"
+#include "Reconciler.h"
+#include "SortStats.h"
+#include "BeltProfile.h"
+#include "BatchPacker.h"
 
 // ==== WEIGHT SETTINGS ====
 #define MIN_WEIGHT 100   // grams - Khối lượng tối thiểu
@@ -55,15 +80,40 @@
 #define SERVO1_PIN 36
 #define SERVO2_PIN 45
 
-// Servo angles for sorting
-#define SERVO1_HOME 175
-#define SERVO1_SORT 45
-#define SERVO2_HOME 180
-#define SERVO2_SORT 115
+// Servo angles for sorting (tunable at runtime, see registerParams())
+int SERVO1_HOME = 175;
+int SERVO1_SORT = 45;
+int SERVO2_HOME = 180;
+int SERVO2_SORT = 115;
+
+// Sorting limits and diverter hold times
+int BIN1_MAX_G = 50;      // grams - <= this goes to bin 1
+int BIN2_MAX_G = 200;     // grams - <= this goes to bin 2, above to bin 3
+int SORT_HOLD_MS = 4000;  // ms - diverter hold for bin 1/2
+int PASS_HOLD_MS = 1500;  // ms - wait for a bin 3 product to pass
+
+// Weight/detection reconciliation
+int REJECT_BIN = 3;              // Bin for products without a verified weight
+int WEIGHT_TIMEOUT_MS = 15000;   // ms - weight not claimed by a product in time is dropped
+int MANUAL_WEIGHT = 0;           // 1 = test mode: products without weight use currentWeight
+
+// Target-weight batching (instead of fixed weight ranges)
+int BATCH_MODE = 0;         // 1 = fill bins to BATCH_TARGET_G with least giveaway
+int BATCH_TARGET_G = 500;   // grams - pack is complete at or above this
+BatchPacker packer;
 
 // Motor Parameters
-static const float SPEED_STEPS_S  = 3500.0f;   // steps/second
-static const float ACCEL_STEPS_S2 = 30000.0f;  // steps/second^2
+float SPEED_STEPS_S  = 3500.0f;   // steps/second
+float ACCEL_STEPS_S2 = 30000.0f;  // steps/second^2 (max, also FastAccelStepper's ramp)
+float JERK_STEPS_S3  = 300000.0f; // steps/second^3 (0 = plain trapezoid)
+
+// Belt motion: S-curve speed setpoints fed to FastAccelStepper
+#define BELT_TICK_MS 10  // Setpoint update period
+#define BELT_MIN_HZ  50  // A stopping belt below this is handed to stopMove()
+#define BELT_MIN_ACCEL 200  // steps/s^2 floor for the per-tick stepper ramp
+BeltProfile beltProfile;
+bool beltStopping = false;  // Decelerating to 0 (isRunning stays true meanwhile)
+uint32_t lastBeltUs = 0;
 
 FastAccelStepperEngine engine;
 FastAccelStepper* stepper = nullptr;
@@ -82,20 +132,88 @@ bool directionForward = true;  // true = forward, false = backward
 // Product counting variables
 int productCount = 0;
 bool objectDetected = false;
-const float DETECTION_THRESHOLD = 70.0;  // mm - ngưỡng phát hiện sản phẩm
+float DETECTION_THRESHOLD = 70.0;  // mm - ngưỡng phát hiện sản phẩm
 unsigned long lastCountTime = 0;
-const unsigned long COUNT_COOLDOWN = 500;  // ms - thời gian chờ giữa 2 lần đếm
-int currentWeight = 0;  // Khối lượng hiện tại (có thể điều chỉnh bằng nút hoặc nhận từ ESP-NOW Serial)
+int COUNT_COOLDOWN = 500;  // ms - thời gian chờ giữa 2 lần đếm
+int currentWeight = 0;  // Khối lượng hiện tại (có thể điều chỉnh bằng nút hoặc nhận từ ESP-NOW)
 bool isIncreasing = true;  // true = đang tăng, false = đang giảm
 
-// ESP-NOW Serial variables
+// ESP-NOW variables
 #define ESPNOW_WIFI_CHANNEL 1
-const MacAddress peer_mac({0x20, 0xE7, 0xC8, 0x67, 0x39, 0x70}); // MAC cua Module 1
-ESP_NOW_Serial_Class NowSerial(peer_mac, ESPNOW_WIFI_CHANNEL, WIFI_IF_STA);
+const uint8_t peer_mac[6] = {0x20, 0xE7, 0xC8, 0x67, 0x39, 0x70}; // MAC cua Module 1
+EspNowLink nowLink;
+
+uint32_t weightMsgCount = 0;  // LM_WEIGHT / LM_UNVERIFIED frames handled
+
+// Weights waiting for their product at the SR04 (in Module 1 seq order)
+Reconciler reconciler;
+
+// Per-product stage timestamps (micros()), correlated with Module 1 by seq
+struct ProductTiming {
+  uint16_t seq;
+  bool fromLink;         // false: manual weight, no link stages
+  uint32_t settleAgeUs;  // Module 1: settle -> send (LinkMsg.aux)
+  uint32_t rxUs;         // ESP-NOW receive callback
+  uint32_t handlerUs;    // processReceivedData()
+  uint32_t detectUs;     // checkProductDetection()
+  uint32_t divertUs;     // actuateDiverter(): diverter moved
+  uint32_t releaseUs;    // releaseDiverter(): diverter back home
+};
+
+enum LatStage {
+  LAT_SETTLE_SEND,
+  LAT_RX_HANDLER,
+  LAT_HANDLER_DETECT,
+  LAT_DETECT_DIVERT,
+  LAT_DIVERT_RELEASE,
+  LAT_STAGES
+};
+const char* const LAT_NAMES[LAT_STAGES] = {
+  "settle->send", "rx->handler", "handler->detect", "detect->divert", "divert->release"
+};
+StageLatency stageLatency;
+
+// Running per-bin statistics (O(1) per product, shown on LCD and "stats")
+#define LCD_REFRESH_MS 5000  // Idle refresh so items/min stays current
+#define LCD_STATUS_MS  2000  // How long displayStatus() messages stay up
+SortStats sortStats;
+int statsBin1Max = -1;  // Thresholds the histograms were configured for
+int statsBin2Max = -1;
+uint32_t lcdRefreshAtMs = 0;  // Next updateLCD() from loop()
+
+// Trace recording (record/replay of raw inputs)
+#define TRACE_CAPACITY_PSRAM 200000  // records (10 bytes each, ~2 MB)
+#define TRACE_CAPACITY_HEAP  4096    // fallback when no PSRAM
+#define SERIAL_TX_BUFFER     1024    // Room for whole dump frames (DumpFrame.h)
+TraceLog traceLog;
 
-bool newWeightReceived = false;
-float receivedWeightKg = 0.0;
-String receiveBuffer = "";  // Buffer để lưu dữ liệu nhận được
+// Per-product sort ledger (traceability for shift reports)
+#define LEDGER_CAPACITY_PSRAM 120000  // entries (18 bytes each, ~2.1 MB)
+#define LEDGER_CAPACITY_HEAP  512     // fallback when no PSRAM
+SortLedger sortLedger;
+uint32_t lastDivertMs = 0;  // Set by actuateDiverter() when the diverter moves
+uint32_t lastDivertUs = 0;
+
+// Diverter hold (released from loop(), never blocks detection)
+bool diverterActive = false;
+int diverterBin = 0;
+uint32_t diverterReleaseMs = 0;
+ProductTiming diverterTiming = {};  // Product currently held by the diverter
+uint32_t diverterPreempted = 0;     // Hold cut short by the next product
+uint64_t diverterLedgerIdx = 0;     // Ledger entry of the product being held
+
+// Binary dump in progress (streamed from loop())
+enum DumpKind { DUMP_NONE, DUMP_TRACE, DUMP_LEDGER };
+DumpKind activeDump = DUMP_NONE;
+size_t traceDumpOffset = 0;   // bytes already sent
+uint64_t ledgerDumpStart = 0; // first absolute ledger index of the dump
+uint64_t ledgerDumpIndex = 0; // next absolute ledger index
+uint64_t ledgerDumpEnd = 0;   // snapshot of sortLedger.total() at start
+
+// Runtime parameters (serial get/set, persisted in NVS)
+ParamRegistry params;
+CommandLine serialCmd;
+Preferences prefs;
 
 // Button state structure (similar to test code)
 struct Btn {
@@ -123,88 +241,110 @@ void handleStartButton();
 void handleStopButton();
 void handleWeightButton();
 Event pollButton(Btn &b);
-void sortProduct(int weight);
+int sortProduct(int weight);
+int rejectProduct(const char* reason);
+int packProduct(float grams);
+void configurePacker();
+void printPack();
+void actuateDiverter(int bin);
+void endDiverterHold();
+void releaseDiverter();
+void serviceDiverter();
 void resetServos();
+void beltStart();
+void beltStop();
+void serviceBelt();
 void processReceivedData();
+void handleSerialCommand();
+void registerParams();
+void loadParams();
+void saveParams();
+void applyParams();
+void serviceDump();
+void recordTiming(const ProductTiming& t);
+void printLatency();
+void printRecon();
+void printStats();
+void configureStatsBins();
 
-// Hàm xử lý dữ liệu nhận từ ESP-NOW Serial
+// Hàm xử lý dữ liệu nhận từ ESP-NOW (một LinkMsg mỗi frame)
 void processReceivedData() {
-  // Đọc dữ liệu từ NowSerial
-  while (NowSerial.available()) {
-    char c = NowSerial.read();
+  LinkRx rx;
+  while (nowLink.receive(rx)) {
+    const LinkMsg& m = rx.msg;
+    uint32_t handlerUs = micros();
+    traceLog.record(handlerUs, TR_NOW_RX, m.type, m.value);
+    traceLog.record(handlerUs, TR_NOW_SEQ, m.type, m.seq);  // Replay rebuilds the frame
+    if (m.type == LM_HELLO) {
+      // Module 1 đang (re)connect: seq sẽ bắt đầu lại từ 1
+      reconciler.resetSequence();
+      continue;
+    }
+    if (m.type != LM_WEIGHT && m.type != LM_UNVERIFIED) continue;
+    bool verified = m.type == LM_WEIGHT;
+
+    // ACK ngay để Module 1 đo độ trễ (echo txUs, kèm thời gian chờ trong queue)
+    LinkMsg ack = {};
+    ack.magic = LINK_MAGIC;
+    ack.type = LM_ACK;
+    ack.seq = m.seq;
+    ack.txUs = m.txUs;
+    ack.value = (int32_t)(handlerUs - rx.rxUs);
+    nowLink.send(ack);
+    traceLog.record(micros(), TR_NOW_TX, LM_ACK, ack.value);
+
+    // Xếp hàng chờ sản phẩm tương ứng đến SR04
+    PendingWeight pw = {};
+    pw.seq = m.seq;
+    pw.weightMg = m.value;
+    pw.unverified = !verified;
+    pw.arrivalMs = millis();
+    pw.settleAgeUs = m.aux;
+    pw.rxUs = rx.rxUs;
+    pw.handlerUs = handlerUs;
+    weightMsgCount++;
+    if (!reconciler.onWeight(pw)) {
+      Serial.printf(">>> ESP-NOW: duplicate weight seq %u ignored\n", (unsigned)m.seq);
+      continue;
+    }
+    int grams = m.value / 1000;
+    if (verified) currentWeight = grams;
+
+    Serial.println("=================================================");
+    Serial.println(">>> ESP-NOW: Received weight data");
+    Serial.printf("    Seq: %u, queued %ld us, pending %u\n", (unsigned)m.seq,
+                  (long)ack.value, (unsigned)reconciler.pending());
+    Serial.printf("    Weight: %.3f kg (%d g)%s\n", m.value / 1000000.0f, grams,
+                  verified ? "" : " UNVERIFIED -> reject");
+    Serial.println("=================================================");
     
-    if (c == '\n' || c == '\r') {
-      // Đã nhận đủ một dòng, xử lý
-      if (receiveBuffer.length() > 0 && receiveBuffer.startsWith("Khoi_luong:")) {
-        // Parse chuỗi: "Khoi_luong:XXX.XXXg"
-        // Bỏ phần "Khoi_luong:" (11 ký tự) và lấy phần số
-        String weightStr = receiveBuffer.substring(11); // Bỏ "Khoi_luong:"
-        weightStr.replace("g", ""); // Xóa ký tự 'g'
-        weightStr.trim(); // Xóa khoảng trắng thừa
-        
-        Serial.printf("[DEBUG] Buffer: '%s'\n", receiveBuffer.c_str());
-        Serial.printf("[DEBUG] weightStr after parse: '%s'\n", weightStr.c_str());
-        
-        float weight_g = weightStr.toFloat();
-        
-        // Cập nhật khối lượng - Dùng trực tiếp giá trị nhận được
-        currentWeight = (int)weight_g;
-        receivedWeightKg = weight_g / 1000.0;
-        newWeightReceived = true;
-          
-        Serial.println("=================================================");
-        Serial.println(">>> ESP-NOW Serial: Received weight data");
-        Serial.printf("    Raw data: %s\n", receiveBuffer.c_str());
-        Serial.printf("    Parsed weight string: %s\n", weightStr.c_str());
-        Serial.printf("    Weight: %.3f kg (%d g)\n", receivedWeightKg, currentWeight);
-        Serial.println("=================================================");
-        
-        // TỰ ĐỘNG BẬT BĂNG CHUYỀN nếu chưa chạy
-        if (!isRunning && currentWeight > 0) {
-          isRunning = true;
-          if (directionForward) {
-            stepper->runForward();
-          } else {
-            stepper->runBackward();
-          }
-          Serial.println(">>> AUTO-START: Conveyor started automatically!");
-        }
-        
-        // Update LCD with received weight - Show "Ready to sort"
-        if (lcd) {
-          lcd->clear();
-          lcd->setCursor(0, 0);
-          lcd->print("Nhan du lieu:");
-          lcd->setCursor(0, 1);
-          lcd->print(currentWeight);
-          lcd->print("g - San sang");
-        }
-        
-        delay(2000);  // Show for 2 seconds
-        updateLCD();  // Return to normal display
-      }
-      
-      // Reset buffer
-      receiveBuffer = "";
-    } else {
-      // Thêm ký tự vào buffer
-      receiveBuffer += c;
-      
-      // Giới hạn buffer size
-      if (receiveBuffer.length() > 100) {
-        receiveBuffer = "";
-      }
+    // TỰ ĐỘNG BẬT BĂNG CHUYỀN nếu chưa chạy
+    if (!isRunning && grams > 0) {
+      beltStart();
+      Serial.println(">>> AUTO-START: Conveyor started automatically!");
     }
+    
+    // LCD: the diverter owns the display while it holds a product
+    if (!diverterActive) updateLCD();
   }
 }
 
 void setup() {
+  Serial.setTxBufferSize(SERIAL_TX_BUFFER);  // Before begin()
   Serial.begin(115200);
   delay(100);
   Serial.println("=== Conveyor Control System - MODULE 2 ===");
-  Serial.println("=== ESP-NOW Serial Receiver ===");
+  Serial.println("=== ESP-NOW Receiver ===");
+
+  // Tunable parameters: compiled-in defaults, overridden by NVS
+  registerParams();
+  loadParams();
+  stageLatency.begin(LAT_NAMES, LAT_STAGES);
+  sortStats.begin();
+  configureStatsBins();
+  configurePacker();
   
-  // Initialize ESP-NOW Serial
+  // Initialize ESP-NOW
   WiFi.mode(WIFI_STA);
   WiFi.setChannel(ESPNOW_WIFI_CHANNEL);
   
@@ -219,10 +359,38 @@ void setup() {
   Serial.print("Peer MAC (Module 1): ");
   Serial.println("20:E7:C8:67:39:70");
   
-  // Khởi động ESP-NOW Serial
-  NowSerial.begin(115200);
-  Serial.println("[ESP-NOW Serial] Initialized successfully");
-  Serial.println("[ESP-NOW Serial] Ready to receive weight data from Module 1");
+  // Khởi động ESP-NOW (datagram, callback -> queue)
+  if (nowLink.begin(peer_mac, ESPNOW_WIFI_CHANNEL)) {
+    Serial.println("[ESP-NOW] Initialized successfully");
+    Serial.println("[ESP-NOW] Ready to receive weight data from Module 1");
+  } else {
+    Serial.println("[ESP-NOW] ERROR: init failed!");
+  }
+
+  // Trace buffer: PSRAM if available, otherwise a small heap buffer
+  size_t traceCap = TRACE_CAPACITY_PSRAM;
+  TraceRecord* traceBuf = nullptr;
+  if (psramFound()) {
+    traceBuf = (TraceRecord*)ps_malloc(traceCap * sizeof(TraceRecord));
+  }
+  if (!traceBuf) {
+    traceCap = TRACE_CAPACITY_HEAP;
+    traceBuf = (TraceRecord*)malloc(traceCap * sizeof(TraceRecord));
+  }
+  traceLog.attach(traceBuf, traceBuf ? traceCap : 0);
+  Serial.printf("[Trace] Buffer: %u records\n", (unsigned)traceLog.capacity());
+
+  size_t ledgerCap = LEDGER_CAPACITY_PSRAM;
+  LedgerEntry* ledgerBuf = nullptr;
+  if (psramFound()) {
+    ledgerBuf = (LedgerEntry*)ps_malloc(ledgerCap * sizeof(LedgerEntry));
+  }
+  if (!ledgerBuf) {
+    ledgerCap = LEDGER_CAPACITY_HEAP;
+    ledgerBuf = (LedgerEntry*)malloc(ledgerCap * sizeof(LedgerEntry));
+  }
+  sortLedger.attach(ledgerBuf, ledgerBuf ? ledgerCap : 0);
+  Serial.printf("[Ledger] Buffer: %u entries\n", (unsigned)sortLedger.capacity());
 
   // Initialize button pins with internal pull-up
   pinMode(BTN_START, INPUT_PULLUP);
@@ -288,8 +456,10 @@ void setup() {
   stepper->setEnablePin(PIN_EN, true);   // EN active LOW
   stepper->setAutoEnable(true);
 
-  stepper->setSpeedInHz((uint32_t)SPEED_STEPS_S);
+  stepper->setSpeedInHz(BELT_MIN_HZ);
   stepper->setAcceleration((uint32_t)ACCEL_STEPS_S2);
+  beltProfile.configure(ACCEL_STEPS_S2, JERK_STEPS_S3);
+  beltProfile.reset(0);
 
   Serial.println("System ready!");
   Serial.println("START: GPIO4 | STOP: GPIO5 | WEIGHT: GPIO6");
@@ -306,11 +476,18 @@ void updateLCD() {
   if (!lcd) return;  // Skip if LCD not available
   
   lcd->clear();
+  uint32_t now = millis();
+  lcdRefreshAtMs = now + LCD_REFRESH_MS;
   
-  // Line 1: Product count
+  // Line 1: Product count and items/min (last 60 s). Short label once
+  // the full one would push the rate past column 16
+  char line[24];
+  unsigned rate = (unsigned)sortStats.perMinute(now);
+  if (snprintf(line, sizeof(line), "Count:%d %u/m", productCount, rate) > 16) {
+    snprintf(line, sizeof(line), "N:%d %u/m", productCount, rate);
+  }
   lcd->setCursor(0, 0);
-  lcd->print("Count: ");
-  lcd->print(productCount);
+  lcd->print(line);
   
   // Line 2: Weight
   lcd->setCursor(0, 1);
@@ -330,10 +507,9 @@ void displayStatus(const char* line1, const char* line2) {
     lcd->setCursor(0, 1);
     lcd->print(line2);
   }
-  delay(2000);
   
-  // Return to normal display
-  updateLCD();
+  // Return to normal display from loop(): the belt ramp must keep running
+  lcdRefreshAtMs = millis() + LCD_STATUS_MS;
 }
 
 // Read distance from SR04 sensor
@@ -345,8 +521,13 @@ float readDistance_mm() {
   digitalWrite(US_TRIG, LOW);
   
   unsigned long dur = pulseIn(US_ECHO, HIGH, US_TIMEOUT_US);
-  if (dur == 0) return -1.0;  // No echo
-  return (dur * 0.343f) * 0.5f;  // Return distance in mm
+  if (dur == 0) {
+    traceLog.record(micros(), TR_SR04, 0, -1);
+    return -1.0;  // No echo
+  }
+  float mm = (dur * 0.343f) * 0.5f;  // Distance in mm
+  traceLog.record(micros(), TR_SR04, 0, (int32_t)(mm * 10.0f));
+  return mm;
 }
 
 // Reset servos to home position
@@ -355,67 +536,137 @@ void resetServos() {
   servo2.write(SERVO2_HOME);
 }
 
-// Sort product based on weight
-void sortProduct(int weight) {
+// Sort product based on weight, returns the bin number (1..3)
+int sortProduct(int weight) {
   Serial.println(">>> Sorting product...");
   
-  if (weight > 0 && weight <= 50) {
-    // Light product: Servo1 @ 70°
-    Serial.println("    Category: Light (0-50g) -> Bin 1");
-    
-    // Display on LCD
-    if (lcd) {
-      lcd->clear();
-      lcd->setCursor(0, 0);
-      lcd->print("Sorting: BIN 1");
-      lcd->setCursor(0, 1);
-      lcd->print("Light: ");
-      lcd->print(weight);
-      lcd->print("g");
+  int bin;
+  const char* label;
+  if (weight > 0 && weight <= BIN1_MAX_G) {
+    // Light product: Servo1 @ SERVO1_SORT
+    Serial.printf("    Category: Light (0-%dg) -> Bin 1\n", BIN1_MAX_G);
+    bin = 1;
+    label = "Light: ";
+  } else if (weight > BIN1_MAX_G && weight <= BIN2_MAX_G) {
+    // Medium product: Servo2 @ SERVO2_SORT
+    Serial.printf("    Category: Medium (%d-%dg) -> Bin 2\n", BIN1_MAX_G, BIN2_MAX_G);
+    bin = 2;
+    label = "Medium: ";
+  } else {
+    // Heavy product: Both @ home position (pass through)
+    Serial.printf("    Category: Heavy (>%dg) -> Bin 3 (End)\n", BIN2_MAX_G);
+    bin = 3;
+    label = "Heavy: ";
+  }
+
+  // Display on LCD (until the diverter is released)
+  if (lcd) {
+    lcd->clear();
+    lcd->setCursor(0, 0);
+    lcd->print("Sorting: BIN ");
+    lcd->print(bin);
+    lcd->setCursor(0, 1);
+    lcd->print(label);
+    lcd->print(weight);
+    lcd->print("g");
+  }
+
+  actuateDiverter(bin);
+  return bin;
+}
+
+// Batching mode: the bin where the product adds the least expected giveaway
+int packProduct(float grams) {
+  PackDecision d = packer.place(grams);
+  if (d.bin == 0) return rejectProduct("no pack bin");
+
+  Serial.printf(">>> Batch: %.1f g -> Bin %d (fill %.1f/%d g)\n", grams, d.bin,
+                d.completes ? d.packG : packer.fill(d.bin), BATCH_TARGET_G);
+  if (d.completes) {
+    // Pack-complete event: operator swaps the box of this bin
+    Serial.printf("PACK COMPLETE bin=%d items=%u weight=%.1f giveaway=%.1f g\n", d.bin,
+                  (unsigned)d.packItems, d.packG, d.giveawayG);
+  }
+  if (lcd) {
+    lcd->clear();
+    lcd->setCursor(0, 0);
+    lcd->print(d.completes ? "PACK DONE: BIN " : "Pack: BIN ");
+    lcd->print(d.bin);
+    lcd->setCursor(0, 1);
+    lcd->print((int)(d.completes ? d.packG : packer.fill(d.bin)));
+    lcd->print("/");
+    lcd->print(BATCH_TARGET_G);
+    lcd->print("g");
+  }
+  actuateDiverter(d.bin);
+  return d.bin;
+}
+
+// Product without a verified weight: REJECT_BIN instead of a guess
+int rejectProduct(const char* reason) {
+  Serial.printf(">>> REJECT (%s) -> Bin %d\n", reason, REJECT_BIN);
+  if (lcd) {
+    lcd->clear();
+    lcd->setCursor(0, 0);
+    lcd->print("REJECT: BIN ");
+    lcd->print(REJECT_BIN);
+    lcd->setCursor(0, 1);
+    lcd->print(reason);
+  }
+  actuateDiverter(REJECT_BIN);
+  return REJECT_BIN;
+}
+
+// Move the diverter for `bin`; loop() releases it after the hold time
+void actuateDiverter(int bin) {
+  if (diverterActive) {
+    // Next product is already here: finish the previous hold now.
+    // With another bin the held product may not reach its own. The LCD
+    // keeps the new product's decision, so no refresh here.
+    if (bin != diverterBin) {
+      diverterPreempted++;
+      sortLedger.setOutcome(diverterLedgerIdx, LO_UNVERIFIED_PREEMPTED);
     }
-    
+    endDiverterHold();
+  }
+
+  uint32_t holdMs;
+  if (bin == 1) {
     servo1.write(SERVO1_SORT);
     servo2.write(SERVO2_HOME);
-    delay(4000);  // Wait longer for product to pass completely (4 seconds)
-    resetServos();
-    
-  } else if (weight > 50 && weight <= 200) {
-    // Medium product: Servo2 @ 115°
-    Serial.println("    Category: Medium (50-200g) -> Bin 2");
-    
-    // Display on LCD
-    if (lcd) {
-      lcd->clear();
-      lcd->setCursor(0, 0);
-      lcd->print("Sorting: BIN 2");
-      lcd->setCursor(0, 1);
-      lcd->print("Medium: ");
-      lcd->print(weight);
-      lcd->print("g");
-    }
-    
+    holdMs = SORT_HOLD_MS;  // Wait for product to pass completely
+  } else if (bin == 2) {
     servo1.write(SERVO1_HOME);
     servo2.write(SERVO2_SORT);
-    delay(4000);  // Wait longer for product to pass completely (4 seconds)
-    resetServos();
-    
+    holdMs = SORT_HOLD_MS;
   } else {
-    // Heavy product: Both @ home position (pass through)
-    Serial.println("    Category: Heavy (200-1000g) -> Bin 3 (End)");
-    
-    // Display on LCD
-    if (lcd) {
-      lcd->clear();
-      lcd->setCursor(0, 0);
-      lcd->print("Sorting: BIN 3");
-      lcd->setCursor(0, 1);
-      lcd->print("Heavy: ");
-      lcd->print(weight);
-      lcd->print("g");
-    }
-    
     resetServos();
-    delay(1500);
+    holdMs = PASS_HOLD_MS;
+  }
+  lastDivertMs = millis();
+  lastDivertUs = micros();
+  diverterActive = true;
+  diverterBin = bin;
+  diverterReleaseMs = lastDivertMs + holdMs;
+}
+
+// Servo home and hold accounting, without touching the LCD
+void endDiverterHold() {
+  resetServos();
+  diverterActive = false;
+  diverterTiming.releaseUs = micros();
+  recordTiming(diverterTiming);
+}
+
+// Timed release: hold is over, back to the normal display
+void releaseDiverter() {
+  endDiverterHold();
+  updateLCD();
+}
+
+void serviceDiverter() {
+  if (diverterActive && (int32_t)(millis() - diverterReleaseMs) >= 0) {
+    releaseDiverter();
   }
 }
 
@@ -428,31 +679,72 @@ void checkProductDetection() {
   
   if (distance > 0 && distance < DETECTION_THRESHOLD) {
     // Object detected within threshold
-    if (!objectDetected && (millis() - lastCountTime > COUNT_COOLDOWN)) {
+    if (!objectDetected && (millis() - lastCountTime > (unsigned long)COUNT_COOLDOWN)) {
       objectDetected = true;
       productCount++;
       lastCountTime = millis();
+
+      LedgerEntry entry;
+      entry.seq = (uint32_t)productCount;
+      entry.detectMs = lastCountTime;
+      ProductTiming timing = {};
+      uint32_t detectUs = micros();
       
       Serial.println("=================================================");
       Serial.print(">>> Product detected! Count: ");
       Serial.println(productCount);
       Serial.printf("    Distance: %.1f mm\n", distance);
       
-      // Sử dụng khối lượng từ ESP-NOW nếu có, nếu không dùng currentWeight
-      int weightToUse = currentWeight;
-      if (newWeightReceived) {
-        Serial.printf("    Weight (ESP-NOW): %d g (%.3f kg)\n", currentWeight, receivedWeightKg);
-        newWeightReceived = false;  // Reset flag
-      } else {
+      // Khối lượng cũ nhất đang chờ thuộc về sản phẩm này (cùng thứ tự trên băng)
+      PendingWeight pw;
+      ReconResult rr = reconciler.onDetection(lastCountTime, pw);
+      if (rr == RR_MATCHED) {
+        int weight = pw.weightMg / 1000;
+        Serial.printf("    Weight (ESP-NOW seq %u): %d g\n", (unsigned)pw.seq, weight);
+        entry.weightMg = pw.weightMg;
+        entry.outcome = LO_SORTED_LINK;
+        timing.seq = pw.seq;
+        timing.fromLink = true;
+        timing.settleAgeUs = pw.settleAgeUs;
+        timing.rxUs = pw.rxUs;
+        timing.handlerUs = pw.handlerUs;
+        entry.bin = (uint8_t)(BATCH_MODE ? packProduct(pw.weightMg / 1000.0f)
+                                         : sortProduct(weight));
+        sortStats.addSorted(entry.bin, pw.weightMg / 1000.0, lastCountTime);
+      } else if (rr == RR_ORPHAN && MANUAL_WEIGHT) {
         Serial.printf("    Weight (Manual): %d g\n", currentWeight);
+        entry.weightMg = (int32_t)currentWeight * 1000;
+        entry.outcome = LO_SORTED_MANUAL;
+        entry.bin = (uint8_t)(BATCH_MODE ? packProduct(currentWeight) : sortProduct(currentWeight));
+        sortStats.addSorted(entry.bin, currentWeight, lastCountTime);
+      } else if (rr == RR_LOST_FRAME) {
+        Serial.printf("    Weight frame seq %u lost\n", (unsigned)pw.seq);
+        entry.weightMg = 0;
+        entry.outcome = LO_REJECT_LOST_FRAME;
+        entry.bin = (uint8_t)rejectProduct("lost frame");
+        sortStats.addRejected(lastCountTime);
+      } else if (rr == RR_UNVERIFIED) {
+        Serial.printf("    Weight (ESP-NOW seq %u): %.1f g, not trusted by Module 1\n",
+                      (unsigned)pw.seq, pw.weightMg / 1000.0f);
+        entry.weightMg = pw.weightMg;
+        entry.outcome = LO_REJECT_UNVERIFIED;
+        entry.bin = (uint8_t)rejectProduct("unverified weight");
+        sortStats.addRejected(lastCountTime);
+      } else {
+        entry.weightMg = 0;
+        entry.outcome = LO_REJECT_NO_WEIGHT;
+        entry.bin = (uint8_t)rejectProduct("no weight");
+        sortStats.addRejected(lastCountTime);
       }
-      
-      // Sort product based on weight
-      sortProduct(weightToUse);
+      entry.divertMs = lastDivertMs;
+      diverterLedgerIdx = sortLedger.total();
+      sortLedger.append(entry);
+
+      // Stage timing is completed when the diverter is released
+      timing.detectUs = detectUs;
+      timing.divertUs = lastDivertUs;
+      diverterTiming = timing;
       Serial.println("=================================================");
-      
-      // Update LCD display
-      updateLCD();
     }
   } else {
     // No object or out of range
@@ -461,13 +753,11 @@ void checkProductDetection() {
 }
 
 void handleStartButton() {
-  if (!isRunning) {
-    isRunning = true;
+  if (!isRunning || beltStopping) {
+    beltStart();
     if (directionForward) {
-      stepper->runForward();
       Serial.println(">> Conveyor STARTED (Forward)");
     } else {
-      stepper->runBackward();
       Serial.println(">> Conveyor STARTED (Backward)");
     }
     
@@ -477,16 +767,81 @@ void handleStartButton() {
 }
 
 void handleStopButton() {
-  if (isRunning) {
-    isRunning = false;
-    stepper->forceStopAndNewPosition(0);
-    Serial.println(">> Conveyor STOPPED");
+  if (isRunning && !beltStopping) {
+    beltStop();
+    Serial.println(">> Conveyor STOPPING");
     
     // Display on LCD
     displayStatus("STOP", "Tam Dung");
   }
 }
 
+// ==== BELT MOTION ====
+
+// Ramp up (or back up, if stopping) to SPEED_STEPS_S along an S-curve
+void beltStart() {
+  if (!stepper) return;
+  bool moving = isRunning;
+  isRunning = true;
+  beltStopping = false;
+  beltProfile.moveTo(SPEED_STEPS_S);
+  lastBeltUs = micros();
+  if (!moving) {
+    stepper->setSpeedInHz(BELT_MIN_HZ);
+    stepper->setAcceleration(BELT_MIN_ACCEL);  // serviceBelt() takes over
+    if (directionForward) {
+      stepper->runForward();
+    } else {
+      stepper->runBackward();
+    }
+  }
+}
+
+// Controlled stop: S-curve down to BELT_MIN_HZ, then stopMove(). Unlike
+// forceStopAndNewPosition() the belt does not jump and the step
+// position keeps counting, so tracked products stay where they are.
+void beltStop() {
+  if (!isRunning || beltStopping) return;
+  beltStopping = true;
+  beltProfile.moveTo(0);
+  lastBeltUs = micros();
+}
+
+// Feed the next profile setpoint every BELT_TICK_MS. FastAccelStepper
+// ramps to each setpoint with a constant acceleration, so that is set per
+// tick to the rate that reaches the setpoint one tick from now: the
+// profile's acceleration averaged over a tick, plus whatever the stepper
+// lags behind. At a fixed ACCEL_STEPS_S2 (or the profile's accel at one
+// instant) it would arrive early and idle, stepping the acceleration.
+void serviceBelt() {
+  if (!stepper || !isRunning) return;
+  uint32_t now = micros();
+  if (now - lastBeltUs < BELT_TICK_MS * 1000UL) return;
+  if (beltProfile.done() && !beltStopping) {
+    lastBeltUs = now;  // Cruising, nothing to change
+    return;
+  }
+  float dt = (now - lastBeltUs) * 1e-6f;
+  float v = beltProfile.update(dt);
+  lastBeltUs = now;
+  float hz = fabsf(stepper->getCurrentSpeedInMilliHz() / 1000.0f);
+  float set = v < BELT_MIN_HZ ? BELT_MIN_HZ : v;
+  float a = fabsf(set - hz) / dt;
+  if (a > ACCEL_STEPS_S2) a = ACCEL_STEPS_S2;
+
+  if (beltStopping && v < BELT_MIN_HZ) {
+    stepper->stopMove();  // A few steps from BELT_MIN_HZ
+    beltProfile.reset(0);
+    beltStopping = false;
+    isRunning = false;
+    Serial.printf(">> Conveyor STOPPED at step %ld\n", (long)stepper->getCurrentPosition());
+    return;
+  }
+  stepper->setSpeedInHz((uint32_t)set);
+  stepper->setAcceleration((int32_t)(a < BELT_MIN_ACCEL ? BELT_MIN_ACCEL : a));
+  stepper->applySpeedAcceleration();
+}
+
 void handleWeightButton() {
   // Điều chỉnh khối lượng
   if (isIncreasing) {
@@ -518,6 +873,7 @@ Event pollButton(Btn &b) {
   if (raw != b.lastRaw) { 
     b.tDeb = millis(); 
     b.lastRaw = raw; 
+    traceLog.record(micros(), TR_BUTTON, b.pin, raw);
   }
 
   if (millis() - b.tDeb > DEBOUNCE_MS) {
@@ -535,9 +891,375 @@ Event pollButton(Btn &b) {
   return EV_NONE;
 }
 
+static void printLine(const char* line) {
+  Serial.println(line);
+}
+
+// Lệnh từ Serial (USB), mỗi dòng một lệnh
+void handleSerialCommand() {
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (activeDump != DUMP_NONE) continue;  // Không nhận lệnh khi đang dump
+    if (!serialCmd.feed(c)) continue;
+
+    if (handleParamCommand(params, serialCmd, printLine)) continue;
+
+    const char* cmd = serialCmd.argv(0);
+    if (strcasecmp(cmd, "save") == 0) {
+      saveParams();
+    } else if (strcasecmp(cmd, "load") == 0) {
+      loadParams();
+    } else if (strcasecmp(cmd, "link") == 0) {
+      Serial.printf("weights=%u acks_delivered=%u send_failed=%u rx_dropped=%u rx_foreign=%u\n",
+                    (unsigned)weightMsgCount, (unsigned)nowLink.delivered(),
+                    (unsigned)nowLink.failed(), (unsigned)nowLink.rxDropped(),
+                    (unsigned)nowLink.rxForeign());
+    } else if (strcasecmp(cmd, "lat") == 0) {
+      if (strcasecmp(serialCmd.argv(1), "clear") == 0) {
+        stageLatency.clear();
+        Serial.println("OK");
+      } else {
+        printLatency();
+      }
+    } else if (strcasecmp(cmd, "recon") == 0) {
+      if (strcasecmp(serialCmd.argv(1), "clear") == 0) {
+        reconciler.clearCounters();
+        diverterPreempted = 0;
+        Serial.println("OK");
+      } else {
+        printRecon();
+      }
+    } else if (strcasecmp(cmd, "stats") == 0) {
+      if (strcasecmp(serialCmd.argv(1), "clear") == 0) {
+        sortStats.clear();
+        Serial.println("OK");
+      } else {
+        printStats();
+      }
+    } else if (strcasecmp(cmd, "pack") == 0) {
+      if (strcasecmp(serialCmd.argv(1), "clear") == 0) {
+        packer.clear();
+        Serial.println("OK");
+      } else if (strcasecmp(serialCmd.argv(1), "empty") == 0) {
+        // Incomplete pack taken out by hand; errors worded like "set"
+        const char* arg = serialCmd.argv(2);
+        char* end = nullptr;
+        long bin = strtol(arg, &end, 10);
+        if (end == arg || *end != '\0') {
+          Serial.println("ERR bad value");
+        } else if (!packer.emptyBin((int)bin)) {
+          Serial.printf("ERR out of range (bin 1..%d)\n", BatchPacker::MAX_BINS);
+        } else {
+          Serial.println("OK");
+        }
+      } else {
+        printPack();
+      }
+    } else if (strcasecmp(cmd, "r") == 0) {
+      traceLog.setEnabled(!traceLog.enabled());
+      Serial.printf(">> Trace recording %s (%u/%u records)\n",
+                    traceLog.enabled() ? "ON" : "OFF",
+                    (unsigned)traceLog.size(), (unsigned)traceLog.capacity());
+    } else if (strcasecmp(cmd, "d") == 0) {
+      // Dừng ghi trong lúc dump để dữ liệu nhất quán
+      traceLog.setEnabled(false);
+      activeDump = DUMP_TRACE;
+      traceDumpOffset = 0;
+      Serial.printf("TRACE BEGIN %u %u %u\n", (unsigned)traceLog.size(),
+                    (unsigned)sizeof(TraceRecord), (unsigned)traceLog.overwritten());
+    } else if (strcasecmp(cmd, "l") == 0) {
+      // Snapshot the range; the sort path keeps appending meanwhile
+      activeDump = DUMP_LEDGER;
+      ledgerDumpStart = sortLedger.firstIndex();
+      ledgerDumpIndex = ledgerDumpStart;
+      ledgerDumpEnd = sortLedger.total();
+      Serial.printf("LEDGER BEGIN %u %u %llu\n",
+                    (unsigned)(ledgerDumpEnd - ledgerDumpIndex),
+                    (unsigned)sizeof(LedgerEntry), (unsigned long long)ledgerDumpIndex);
+    } else if (strcasecmp(cmd, "c") == 0) {
+      traceLog.clear();
+      Serial.println(">> Trace cleared");
+    } else if (strcasecmp(cmd, "help") == 0) {
+      Serial.println("list | get NAME | set NAME VALUE | defaults | save | load");
+      Serial.println("r (trace on/off) | d (dump trace) | c (clear trace) | l (dump ledger)");
+      Serial.println("link | lat [clear] | recon [clear] | stats [clear]");
+      Serial.println("pack [clear | empty N]");
+    } else {
+      Serial.println("ERR unknown command (help)");
+    }
+  }
+}
+
+// ==== LATENCY TRACING ====
+
+// Add one product's stage durations and log them by seq, so the line
+// can be matched with the "LAT seq=..." line printed by Module 1.
+void recordTiming(const ProductTiming& t) {
+  uint32_t d[LAT_STAGES] = {};
+  if (t.fromLink) {
+    d[LAT_SETTLE_SEND] = t.settleAgeUs;
+    d[LAT_RX_HANDLER] = t.handlerUs - t.rxUs;
+    d[LAT_HANDLER_DETECT] = t.detectUs - t.handlerUs;
+    stageLatency.add(LAT_SETTLE_SEND, d[LAT_SETTLE_SEND]);
+    stageLatency.add(LAT_RX_HANDLER, d[LAT_RX_HANDLER]);
+    stageLatency.add(LAT_HANDLER_DETECT, d[LAT_HANDLER_DETECT]);
+  }
+  d[LAT_DETECT_DIVERT] = t.divertUs - t.detectUs;
+  d[LAT_DIVERT_RELEASE] = t.releaseUs - t.divertUs;
+  stageLatency.add(LAT_DETECT_DIVERT, d[LAT_DETECT_DIVERT]);
+  stageLatency.add(LAT_DIVERT_RELEASE, d[LAT_DIVERT_RELEASE]);
+
+  if (t.fromLink) {
+    Serial.printf("LAT seq=%u settle->send=%lu rx->handler=%lu handler->detect=%lu "
+                  "detect->divert=%lu divert->release=%lu us\n", (unsigned)t.seq,
+                  (unsigned long)d[0], (unsigned long)d[1], (unsigned long)d[2],
+                  (unsigned long)d[3], (unsigned long)d[4]);
+  } else {
+    Serial.printf("LAT manual detect->divert=%lu divert->release=%lu us\n",
+                  (unsigned long)d[3], (unsigned long)d[4]);
+  }
+}
+
+void printLatency() {
+  Serial.println("stage              count      p50      p95      p99      max (us)");
+  for (size_t i = 0; i < stageLatency.stages(); i++) {
+    StageLatency::Summary sm;
+    if (!stageLatency.summary(i, sm)) {
+      Serial.printf("%-16s       0\n", stageLatency.name(i));
+      continue;
+    }
+    Serial.printf("%-16s %7lu %8lu %8lu %8lu %8lu\n", stageLatency.name(i),
+                  (unsigned long)sm.count, (unsigned long)sm.p50, (unsigned long)sm.p95,
+                  (unsigned long)sm.p99, (unsigned long)sm.max);
+  }
+}
+
+void printRecon() {
+  const ReconCounters& rc = reconciler.counters();
+  Serial.printf("weights=%u matched=%u pending=%u\n", (unsigned)rc.weights,
+                (unsigned)rc.matched, (unsigned)reconciler.pending());
+  Serial.printf("seq_gaps=%u lost_matched=%u lost_orphaned=%u duplicates=%u unverified=%u\n",
+                (unsigned)rc.seqGaps, (unsigned)rc.lostMatched, (unsigned)rc.lostOrphaned,
+                (unsigned)rc.duplicates, (unsigned)rc.unverified);
+  Serial.printf("orphans=%u expired=%u overflow=%u preempted=%u\n", (unsigned)rc.orphans,
+                (unsigned)rc.expired, (unsigned)rc.overflow, (unsigned)diverterPreempted);
+}
+
+// ==== STATISTICS ====
+
+// Histogram ranges follow the sort thresholds (weights are sorted as whole grams)
+void configureStatsBins() {
+  statsBin1Max = BIN1_MAX_G;
+  statsBin2Max = BIN2_MAX_G;
+  sortStats.configureBin(1, 0, BIN1_MAX_G + 1);
+  sortStats.configureBin(2, BIN1_MAX_G + 1, BIN2_MAX_G + 1);
+  sortStats.configureBin(3, BIN2_MAX_G + 1, MAX_WEIGHT);
+}
+
+void printStats() {
+  uint32_t now = millis();
+  Serial.printf("items/min: %u (1 min) %u (10 min avg), rejected %u\n",
+                (unsigned)sortStats.perMinute(now), (unsigned)sortStats.perMinute10(now),
+                (unsigned)sortStats.rejected());
+  for (int b = 1; b <= SortStats::BINS; b++) {
+    const RunningStats& st = sortStats.stats(b);
+    const Histogram& h = sortStats.histogram(b);
+    Serial.printf("bin%d n=%u mean=%.2f sd=%.2f min=%.2f max=%.2f g\n", b,
+                  (unsigned)st.count(), st.mean(), st.stddev(), st.min(), st.max());
+    Serial.printf("  hist [%.0f..%.0f) <%u", h.lo(), h.hi(), (unsigned)h.under());
+    for (size_t i = 0; i < Histogram::BUCKETS; i++) {
+      Serial.printf(" %u", (unsigned)h.bucket(i));
+    }
+    Serial.printf(" >%u\n", (unsigned)h.over());
+  }
+}
+
+// ==== BATCHING ====
+
+// Pack bins: every bin except REJECT_BIN
+void configurePacker() {
+  if (packer.target() != BATCH_TARGET_G) packer.configure(BATCH_TARGET_G);
+  packer.setBinMask((uint8_t)(0x7 & ~(1 << (REJECT_BIN - 1))));
+}
+
+void printPack() {
+  const PackCounters& pc = packer.counters();
+  Serial.printf("batch mode %s, target %d g, model %s\n", BATCH_MODE ? "ON" : "OFF",
+                BATCH_TARGET_G, packer.model().ready() ? "ready" : "learning");
+  for (int b = 1; b <= BatchPacker::MAX_BINS; b++) {
+    if (b == REJECT_BIN) continue;
+    Serial.printf("bin%d fill %.1f g (%u items)\n", b, packer.fill(b), (unsigned)packer.itemsIn(b));
+  }
+  Serial.printf("packs=%u items=%u giveaway avg=%.2f g (%.2f%%)\n", (unsigned)pc.packs,
+                (unsigned)pc.items, pc.packs ? pc.giveawayG / pc.packs : 0.0,
+                pc.packedG > 0 ? 100.0 * pc.giveawayG / pc.packedG : 0.0);
+}
+
+// ==== RUNTIME PARAMETERS ====
+
+// Rules between parameters, checked on the whole staged set
+static const char* checkParams(const ParamRegistry& reg) {
+  if (!(reg.stagedFloat("BIN1_MAX_G") < reg.stagedFloat("BIN2_MAX_G"))) {
+    return "BIN1_MAX_G must be below BIN2_MAX_G";
+  }
+  if (!(reg.stagedFloat("BIN2_MAX_G") < MAX_WEIGHT)) {
+    return "BIN2_MAX_G must be below MAX_WEIGHT";
+  }
+  return nullptr;
+}
+
+void registerParams() {
+  params.setCheck(checkParams);
+  params.addFloat("DETECTION_THRESHOLD", &DETECTION_THRESHOLD, 10, 400);
+  params.addInt("COUNT_COOLDOWN", &COUNT_COOLDOWN, 0, 10000);
+  params.addFloat("SPEED_STEPS_S", &SPEED_STEPS_S, 100, 20000);
+  params.addFloat("ACCEL_STEPS_S2", &ACCEL_STEPS_S2, 100, 200000);
+  params.addFloat("JERK_STEPS_S3", &JERK_STEPS_S3, 0, 10000000);
+  params.addInt("SERVO1_HOME", &SERVO1_HOME, 0, 180);
+  params.addInt("SERVO1_SORT", &SERVO1_SORT, 0, 180);
+  params.addInt("SERVO2_HOME", &SERVO2_HOME, 0, 180);
+  params.addInt("SERVO2_SORT", &SERVO2_SORT, 0, 180);
+  params.addInt("BIN1_MAX_G", &BIN1_MAX_G, 1, 5000);
+  params.addInt("BIN2_MAX_G", &BIN2_MAX_G, 1, 5000);
+  params.addInt("SORT_HOLD_MS", &SORT_HOLD_MS, 0, 10000);
+  params.addInt("PASS_HOLD_MS", &PASS_HOLD_MS, 0, 10000);
+  params.addInt("REJECT_BIN", &REJECT_BIN, 1, 3);
+  params.addInt("WEIGHT_TIMEOUT_MS", &WEIGHT_TIMEOUT_MS, 1000, 120000);
+  params.addInt("MANUAL_WEIGHT", &MANUAL_WEIGHT, 0, 1);
+  params.addInt("BATCH_MODE", &BATCH_MODE, 0, 1);
+  params.addInt("BATCH_TARGET_G", &BATCH_TARGET_G, 10, 5000);
+  if (params.addFailed()) {
+    Serial.printf("ERROR: parameter registry full (%u), %s and later not registered\n",
+                  (unsigned)ParamRegistry::MAX_PARAMS, params.addFailed());
+  }
+}
+
+// Stage values saved in NVS and apply them right away (boot or "load")
+void loadParams() {
+  char key[16];
+  size_t loaded = 0;
+  prefs.begin("conveyor", true);
+  for (size_t i = 0; i < params.count(); i++) {
+    const ParamInfo& pi = params.info(i);
+    ParamRegistry::nvsKey(pi.name, key, sizeof(key));
+    if (!prefs.isKey(key)) continue;
+    ParamValue v;
+    if (pi.type == PT_FLOAT) {
+      v.f = prefs.getFloat(key, pi.def.f);
+    } else {
+      v.i = prefs.getInt(key, pi.def.i);
+    }
+    if (params.setValue(i, v) == PS_OK) loaded++;
+  }
+  prefs.end();
+  Serial.printf("[Params] %u value(s) loaded from NVS\n", (unsigned)loaded);
+  applyParams();
+}
+
+void saveParams() {
+  char key[16];
+  prefs.begin("conveyor", false);
+  for (size_t i = 0; i < params.count(); i++) {
+    const ParamInfo& pi = params.info(i);
+    ParamRegistry::nvsKey(pi.name, key, sizeof(key));
+    ParamValue v = params.value(i);
+    if (pi.type == PT_FLOAT) {
+      prefs.putFloat(key, v.f);
+    } else {
+      prefs.putInt(key, v.i);
+    }
+  }
+  prefs.end();
+  Serial.println("OK saved");
+}
+
+// Safe point: called between products (no detection being handled)
+void applyParams() {
+  if (!params.hasPending()) return;
+  size_t n = params.applyPending();
+  if (params.rejectReason()) {
+    Serial.printf(">> Parameters rejected, none applied: %s\n", params.rejectReason());
+    return;
+  }
+  reconciler.setTimeoutMs((uint32_t)WEIGHT_TIMEOUT_MS);
+  configurePacker();
+
+  beltProfile.configure(ACCEL_STEPS_S2, JERK_STEPS_S3);
+  if (stepper) {
+    stepper->setAcceleration((uint32_t)ACCEL_STEPS_S2);
+    if (isRunning && !beltStopping && beltProfile.target() != SPEED_STEPS_S) {
+      // Speed change along the same S-curve as a start
+      beltProfile.moveTo(SPEED_STEPS_S);
+      lastBeltUs = micros();
+    }
+  }
+  if (!diverterActive) resetServos();  // New angles are used from the next product on
+  if (BIN1_MAX_G != statsBin1Max || BIN2_MAX_G != statsBin2Max) {
+    configureStatsBins();  // Histograms restart with the new ranges
+  }
+  Serial.printf(">> %u parameter(s) applied\n", (unsigned)n);
+}
+
+// Stream the active dump a frame at a time so loop() keeps running.
+// One whole frame per write: log lines from the sort path go between
+// frames and the decoder skips them.
+void serviceDump() {
+  if (activeDump == DUMP_NONE) return;
+  if ((size_t)Serial.availableForWrite() < DUMP_FRAME_MAX) return;
+
+  uint8_t chunk[DUMP_FRAME_MAX_DATA];
+  uint8_t frame[DUMP_FRAME_MAX];
+  if (activeDump == DUMP_TRACE) {
+    size_t n = traceLog.copyBytes(traceDumpOffset, chunk, sizeof(chunk));
+    if (n > 0) {
+      Serial.write(frame, dumpFrameEncode((uint32_t)traceDumpOffset, chunk, n, frame));
+      traceDumpOffset += n;
+    }
+    if (traceDumpOffset >= traceLog.sizeBytes()) {
+      Serial.println();
+      Serial.println("TRACE END");
+      activeDump = DUMP_NONE;
+    }
+  } else {
+    // Whole entries only; overwritten ones come out as LO_LOST
+    uint32_t offset = (uint32_t)((ledgerDumpIndex - ledgerDumpStart) * sizeof(LedgerEntry));
+    size_t n = 0;
+    while (ledgerDumpIndex < ledgerDumpEnd && n + sizeof(LedgerEntry) <= sizeof(chunk)) {
+      LedgerEntry e;
+      sortLedger.get(ledgerDumpIndex++, e);
+      memcpy(chunk + n, &e, sizeof(e));
+      n += sizeof(e);
+    }
+    if (n > 0) Serial.write(frame, dumpFrameEncode(offset, chunk, n, frame));
+    if (ledgerDumpIndex >= ledgerDumpEnd) {
+      Serial.println();
+      Serial.println("LEDGER END");
+      activeDump = DUMP_NONE;
+    }
+  }
+}
+
 void loop() {
-  // Process received data from ESP-NOW Serial
+  // Belt speed setpoints (S-curve ramps)
+  serviceBelt();
+
+  // Process received data from ESP-NOW
   processReceivedData();
+
+  // Serial commands and pending binary dump
+  handleSerialCommand();
+  serviceDump();
+
+  // Apply staged parameter changes (no product is being sorted here)
+  applyParams();
+
+  // Diverter release and stale weights (product removed / never seen)
+  serviceDiverter();
+  packer.maintain();  // Giveaway table rebuild, kept out of the sort path
+  size_t expired = reconciler.expire(millis());
+  if (expired) {
+    Serial.printf(">>> %u weight(s) expired without a product\n", (unsigned)expired);
+  }
   
   // Check all buttons with debounce (detect on button release)
   Event e1 = pollButton(btnStart);
@@ -561,6 +1283,11 @@ void loop() {
   
   // Check for product detection when conveyor is running
   checkProductDetection();
+
+  // Back from status messages; keeps items/min current on an idle line
+  if (!diverterActive && (int32_t)(millis() - lcdRefreshAtMs) >= 0) {
+    updateLCD();
+  }
   
   delay(10);  // Small delay for stability
 }
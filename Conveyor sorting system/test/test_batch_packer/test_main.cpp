@@ -0,0 +1,197 @@
+// Host tests and benchmark for BatchPacker (pio test -e native -v shows
+// the report): pack accounting, the expected-giveaway table, and decision
+// latency / giveaway over large simulated weight distributions.
+#include <unity.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "BatchPacker.h"
+
+#define BENCH_ITEMS 200000  // Per distribution
+
+// Deterministic samples (LCG + Box-Muller), as in test_sort_stats
+struct Rng {
+  uint64_t s = 12345;
+  double uniform() {
+    s = s * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((s >> 11) + 0.5) / 9007199254740992.0;  // (0, 1)
+  }
+  double normal(double mean, double sd) {
+    return mean + sd * sqrt(-2.0 * log(uniform())) * cos(6.283185307179586 * uniform());
+  }
+};
+
+enum Dist { D_NORMAL, D_UNIFORM, D_BIMODAL, D_LOGNORMAL };
+
+struct Case {
+  const char* name;
+  Dist dist;
+  float targetG;
+};
+
+static float draw(Rng& rng, Dist d) {
+  double g = 0;
+  switch (d) {
+    case D_NORMAL: g = rng.normal(120, 30); break;
+    case D_UNIFORM: g = 50 + 200 * rng.uniform(); break;
+    case D_BIMODAL: g = rng.uniform() < 0.5 ? rng.normal(80, 10) : rng.normal(300, 20); break;
+    case D_LOGNORMAL: g = exp(rng.normal(4.5, 0.5)); break;
+  }
+  return g < 1 ? 1.0f : (float)g;
+}
+
+struct BenchResult {
+  double avgGiveaway;  // Per completed pack
+  uint32_t packs;
+  double p50Ns, p99Ns, maxNs;  // place()
+  double rebuildUs;            // Mean maintain() time when it rebuilt the table
+};
+
+// Items arrive one by one; maintain() runs between items like loop() does
+static BenchResult bench(const Case& c, uint8_t mask) {
+  typedef std::chrono::steady_clock Clock;
+  static BatchPacker packer;  // ~9 KB, off the stack
+  packer = BatchPacker();
+  packer.configure(c.targetG);
+  packer.setBinMask(mask);
+
+  Rng rng;
+  std::vector<float> lat;
+  lat.reserve(BENCH_ITEMS);
+  BenchResult r = {};
+  uint32_t rebuilds = 0;
+  for (int i = 0; i < BENCH_ITEMS; i++) {
+    float g = draw(rng, c.dist);
+    Clock::time_point t0 = Clock::now();
+    packer.place(g);
+    Clock::time_point t1 = Clock::now();
+    lat.push_back((float)std::chrono::duration<double, std::nano>(t1 - t0).count());
+
+    bool due = packer.model().rebuildDue();
+    packer.maintain();
+    if (due) {
+      r.rebuildUs += std::chrono::duration<double, std::micro>(Clock::now() - t1).count();
+      rebuilds++;
+    }
+  }
+  if (rebuilds) r.rebuildUs /= rebuilds;
+  std::sort(lat.begin(), lat.end());
+  r.p50Ns = lat[lat.size() / 2];
+  r.p99Ns = lat[lat.size() * 99 / 100];
+  r.maxNs = lat.back();
+  r.packs = packer.counters().packs;
+  r.avgGiveaway = r.packs ? packer.counters().giveawayG / r.packs : 0;
+  return r;
+}
+
+static BatchPacker pk;
+
+void setUp(void) {
+  pk = BatchPacker();
+  pk.configure(100);
+}
+void tearDown(void) {}
+
+void test_pack_completes(void) {
+  pk.setBinMask(0x1);
+  TEST_ASSERT_FALSE(pk.place(40).completes);
+  TEST_ASSERT_FALSE(pk.place(40).completes);
+  PackDecision d = pk.place(40);
+  TEST_ASSERT_EQUAL_INT(1, d.bin);
+  TEST_ASSERT_TRUE(d.completes);
+  TEST_ASSERT_EQUAL_UINT32(3, d.packItems);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 120, d.packG);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 20, d.giveawayG);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0, pk.fill(1));  // Bin starts a new pack
+
+  const PackCounters& c = pk.counters();
+  TEST_ASSERT_EQUAL_UINT32(3, c.items);
+  TEST_ASSERT_EQUAL_UINT32(1, c.packs);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 20, c.giveawayG);
+}
+
+void test_mask_and_empty(void) {
+  pk.setBinMask(0);
+  TEST_ASSERT_EQUAL_INT(0, pk.place(40).bin);
+  TEST_ASSERT_EQUAL_UINT32(0, pk.counters().items);
+
+  pk.setBinMask(0x4);  // Bin 3 only
+  TEST_ASSERT_EQUAL_INT(3, pk.place(40).bin);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 40, pk.fill(3));
+  TEST_ASSERT_FALSE(pk.emptyBin(0));  // "pack empty N" validates with these
+  TEST_ASSERT_FALSE(pk.emptyBin(4));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 40, pk.fill(3));
+  TEST_ASSERT_TRUE(pk.emptyBin(3));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0, pk.fill(3));
+  TEST_ASSERT_EQUAL_UINT32(0, pk.itemsIn(3));
+}
+
+// Constant weight w: a bin lacking r ends ceil(r/w)*w - r over the target
+void test_model_constant_weight(void) {
+  GiveawayModel m;
+  m.configure(100);
+  for (size_t i = 0; i < GiveawayModel::MIN_SAMPLES; i++) m.addSample(30);
+  TEST_ASSERT_TRUE(m.rebuildDue());
+  m.rebuild();
+  TEST_ASSERT_TRUE(m.ready());
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 20, m.expected(100));  // 4 items: 120
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 5, m.expected(55));    // 2 items: 60
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0, m.expected(30));
+}
+
+// Constant 30 g items, two bins: equal changes in expected giveaway go to
+// the fuller bin, and a 10 g item then closes its pack with no giveaway
+void test_ties_fill_one_bin(void) {
+  pk.setBinMask(0x3);
+  for (size_t i = 0; i < GiveawayModel::MIN_SAMPLES; i++) pk.place(30);
+  pk.maintain();
+  TEST_ASSERT_TRUE(pk.model().ready());
+  pk.clear();
+  for (int i = 0; i < 3; i++) TEST_ASSERT_EQUAL_INT(1, pk.place(30).bin);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 90, pk.fill(1));
+  PackDecision d = pk.place(10);
+  TEST_ASSERT_EQUAL_INT(1, d.bin);
+  TEST_ASSERT_TRUE(d.completes);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0, d.giveawayG);
+}
+
+// Benchmark: expected-giveaway routing over 3 bins against filling one bin
+// at a time, with decision latency and table rebuild time on this host.
+void test_benchmark(void) {
+  static const Case cases[] = {
+    {"normal(120,30)    T=500 ", D_NORMAL, 500},
+    {"uniform(50,250)   T=1000", D_UNIFORM, 1000},
+    {"bimodal 80/300    T=1000", D_BIMODAL, 1000},
+    {"lognormal(4.5,.5) T=2000", D_LOGNORMAL, 2000},
+  };
+  printf("\n%-25s %9s %9s %7s %8s %8s %8s %10s\n", "distribution", "giveaway1", "giveaway3",
+         "packs3", "p50_ns", "p99_ns", "max_ns", "rebuild_us");
+  for (const Case& c : cases) {
+    BenchResult one = bench(c, 0x1);
+    BenchResult dp = bench(c, 0x7);
+    printf("%-25s %9.1f %9.1f %7u %8.0f %8.0f %8.0f %10.1f\n", c.name, one.avgGiveaway,
+           dp.avgGiveaway, (unsigned)dp.packs, dp.p50Ns, dp.p99Ns, dp.maxNs, dp.rebuildUs);
+
+    TEST_ASSERT_TRUE(dp.packs > BENCH_ITEMS / 30);  // At most ~20 items per pack here
+    TEST_ASSERT_TRUE(dp.avgGiveaway < one.avgGiveaway);
+    TEST_ASSERT_TRUE(dp.p50Ns < 2000);  // Host, generous: O(bins) lookups
+  }
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_pack_completes);
+  RUN_TEST(test_mask_and_empty);
+  RUN_TEST(test_model_constant_weight);
+  RUN_TEST(test_ties_fill_one_bin);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// Host tests for BeltProfile (pio test -e native): jerk and accel limits
+// of the planned step rate, including a new plan started mid-ramp.
+#include <unity.h>
+
+#include <math.h>
+
+#include "BeltProfile.h"
+
+#define A_MAX 30000.0f   // Firmware defaults
+#define J_MAX 300000.0f
+#define V_RUN 3500.0f
+#define DT    0.001f
+#define DIST_TOL (V_RUN * DT)  // Last sample runs past the end of the plan
+
+// Limits seen while sampling a plan every DT
+struct Trace {
+  float maxAccel = 0.0f;
+  float maxJerk = 0.0f;
+  float maxStep = 0.0f;    // Largest speed change in one sample
+  float minSpeed = 1e9f;
+  float maxSpeed = -1e9f;
+  double steps = 0.0;      // Integrated distance
+};
+
+static BeltProfile prof;
+static float lastA, lastV;  // Previous sample, also across a new plan
+
+// Sample until the plan ends (or `ms` samples); a new plan is checked at
+// its seam with the old one.
+static void run(Trace& tr, int ms = 100000) {
+  for (int i = 0; i < ms && !prof.done(); i++) {
+    float v = prof.update(DT);
+    float a = prof.accel();
+    tr.maxAccel = fmaxf(tr.maxAccel, fabsf(a));
+    tr.maxJerk = fmaxf(tr.maxJerk, fabsf(a - lastA) / DT);
+    tr.maxStep = fmaxf(tr.maxStep, fabsf(v - lastV));
+    tr.minSpeed = fminf(tr.minSpeed, v);
+    tr.maxSpeed = fmaxf(tr.maxSpeed, v);
+    tr.steps += 0.5 * (v + lastV) * DT;
+    lastA = a;
+    lastV = v;
+  }
+}
+
+void setUp(void) {
+  prof.configure(A_MAX, J_MAX);
+  prof.reset(0);
+  lastA = lastV = 0.0f;
+}
+void tearDown(void) {}
+
+void test_start_from_rest(void) {
+  prof.moveTo(V_RUN);
+  float d = prof.distance();
+  // A^2/J = 3000 < 3500: constant-accel phase of 3500/A - A/J
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2 * A_MAX / J_MAX + V_RUN / A_MAX - A_MAX / J_MAX,
+                           prof.duration());
+  Trace tr;
+  run(tr);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, A_MAX, tr.maxAccel);
+  TEST_ASSERT_TRUE(tr.maxJerk <= J_MAX * 1.001f);
+  TEST_ASSERT_EQUAL_FLOAT(V_RUN, prof.speed());
+  TEST_ASSERT_FLOAT_WITHIN(DIST_TOL, d, (float)tr.steps);
+}
+
+// STOP while the start is at peak accel: the accel ramps down, no jump
+void test_stop_mid_start(void) {
+  prof.moveTo(V_RUN);
+  Trace tr;
+  run(tr, 108);  // Constant-accel phase: 100..116 ms
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, A_MAX, prof.accel());
+  float peak = prof.speed();
+
+  prof.moveTo(0);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, A_MAX, prof.accel());  // Plan starts where it was
+  float d = prof.distance();
+  double before = tr.steps;
+  run(tr);
+  TEST_ASSERT_TRUE(tr.maxJerk <= J_MAX * 1.001f);
+  TEST_ASSERT_TRUE(tr.maxAccel <= A_MAX * 1.001f);
+  TEST_ASSERT_TRUE(tr.maxStep <= A_MAX * DT * 1.001f);
+  TEST_ASSERT_TRUE(tr.maxSpeed > peak);  // Still gains speed while the accel falls
+  TEST_ASSERT_TRUE(tr.minSpeed >= 0.0f);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, prof.speed());
+  TEST_ASSERT_FLOAT_WITHIN(DIST_TOL, d, (float)(tr.steps - before));
+}
+
+// Target equal to the current speed while accelerating: overshoot and back
+void test_retarget_to_current_speed(void) {
+  prof.moveTo(V_RUN);
+  Trace tr;
+  run(tr, 50);
+  float v = prof.speed();
+  prof.moveTo(v);
+  TEST_ASSERT_TRUE(prof.duration() > 0.0f);
+  run(tr);
+  TEST_ASSERT_TRUE(tr.maxJerk <= J_MAX * 1.001f);
+  TEST_ASSERT_TRUE(tr.maxSpeed > v);
+  TEST_ASSERT_EQUAL_FLOAT(v, prof.speed());
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, prof.accel());
+}
+
+// Small speed change: triangular accel that never reaches A
+void test_short_change(void) {
+  prof.reset(V_RUN);
+  lastV = V_RUN;
+  prof.moveTo(V_RUN - 500);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2 * sqrtf(500 / J_MAX), prof.duration());
+  Trace tr;
+  run(tr);
+  TEST_ASSERT_TRUE(tr.maxAccel < A_MAX);
+  TEST_ASSERT_TRUE(tr.maxJerk <= J_MAX * 1.001f);
+  TEST_ASSERT_TRUE(tr.minSpeed >= V_RUN - 500 - 1e-3f);
+}
+
+// Jerk 0 keeps the plain trapezoid, also when replanned mid-ramp
+void test_trapezoid(void) {
+  prof.configure(A_MAX, 0);
+  prof.moveTo(V_RUN);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, V_RUN / A_MAX, prof.duration());
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 0.5f * V_RUN * V_RUN / A_MAX, prof.distance());
+  prof.update(0.05f);
+  prof.moveTo(0);
+  TEST_ASSERT_EQUAL_FLOAT(-A_MAX, prof.accel());
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.05f, prof.duration());
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_start_from_rest);
+  RUN_TEST(test_stop_mid_start);
+  RUN_TEST(test_retarget_to_current_speed);
+  RUN_TEST(test_short_change);
+  RUN_TEST(test_trapezoid);
+  return UNITY_END();
+}
@@ -0,0 +1,198 @@
+// Host tests for ParamRegistry / CommandLine / handleParamCommand
+// (pio test -e native).
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "ParamRegistry.h"
+
+static float gThreshold;
+static int gBin1;
+static int gBin2;
+static ParamRegistry reg;
+static CommandLine cmd;
+static std::vector<std::string> lines;
+
+static void collect(const char* line) { lines.push_back(line); }
+
+static const char* binsOrdered(const ParamRegistry& r) {
+  if (!(r.stagedFloat("BIN1_MAX_G") < r.stagedFloat("BIN2_MAX_G"))) return "bins";
+  return nullptr;
+}
+
+// Feed a whole line; true if it produced a command
+static bool feedLine(const char* text) {
+  bool ready = false;
+  for (const char* c = text; *c; c++) ready = cmd.feed(*c) || ready;
+  return ready;
+}
+
+// Run one protocol command, return its first output line
+static std::string run(const char* text) {
+  lines.clear();
+  TEST_ASSERT_TRUE(feedLine(text));
+  TEST_ASSERT_TRUE(handleParamCommand(reg, cmd, collect));
+  TEST_ASSERT_FALSE(lines.empty());
+  return lines[0];
+}
+
+void setUp(void) {
+  gThreshold = 70.0f;
+  gBin1 = 50;
+  gBin2 = 200;
+  reg = ParamRegistry();
+  reg.addFloat("DETECTION_THRESHOLD", &gThreshold, 10, 400);
+  reg.addInt("BIN1_MAX_G", &gBin1, 1, 5000);
+  reg.addInt("BIN2_MAX_G", &gBin2, 1, 5000);
+  reg.setCheck(binsOrdered);
+  cmd = CommandLine();
+}
+
+void tearDown(void) {}
+
+void test_line_tokens(void) {
+  TEST_ASSERT_TRUE(feedLine("set  BIN1_MAX_G\t60\r\n"));
+  TEST_ASSERT_EQUAL_INT(3, cmd.argc());
+  TEST_ASSERT_EQUAL_STRING("set", cmd.argv(0));
+  TEST_ASSERT_EQUAL_STRING("BIN1_MAX_G", cmd.argv(1));
+  TEST_ASSERT_EQUAL_STRING("60", cmd.argv(2));
+  TEST_ASSERT_EQUAL_STRING("", cmd.argv(3));
+  // The LF of the CRLF above must not produce an empty command
+  TEST_ASSERT_FALSE(feedLine("\n"));
+  TEST_ASSERT_FALSE(feedLine("   \n"));
+}
+
+// The last argument keeps the rest of the line
+void test_line_too_many_args(void) {
+  TEST_ASSERT_TRUE(feedLine("a b c d e f\n"));
+  TEST_ASSERT_EQUAL_INT((int)CommandLine::MAX_ARGS, cmd.argc());
+  TEST_ASSERT_EQUAL_STRING("d e f", cmd.argv(3));
+}
+
+void test_line_overflow_dropped(void) {
+  std::string longLine(CommandLine::MAX_LEN + 10, 'x');
+  longLine += "\n";
+  TEST_ASSERT_FALSE(feedLine(longLine.c_str()));
+  // The next line is parsed normally
+  TEST_ASSERT_TRUE(feedLine("list\n"));
+  TEST_ASSERT_EQUAL_STRING("list", cmd.argv(0));
+}
+
+void test_set_parse_errors(void) {
+  TEST_ASSERT_EQUAL(PS_UNKNOWN, reg.set("NOPE", "1"));
+  TEST_ASSERT_EQUAL(PS_BAD_VALUE, reg.set("BIN1_MAX_G", ""));
+  TEST_ASSERT_EQUAL(PS_BAD_VALUE, reg.set("BIN1_MAX_G", "12g"));
+  TEST_ASSERT_EQUAL(PS_BAD_VALUE, reg.set("BIN1_MAX_G", "1.5"));
+  TEST_ASSERT_EQUAL(PS_BAD_VALUE, reg.set("DETECTION_THRESHOLD", "abc"));
+  TEST_ASSERT_EQUAL(PS_OUT_OF_RANGE, reg.set("BIN1_MAX_G", "0"));
+  TEST_ASSERT_EQUAL(PS_OUT_OF_RANGE, reg.set("BIN1_MAX_G", "99999999999"));
+  TEST_ASSERT_EQUAL(PS_OUT_OF_RANGE, reg.set("DETECTION_THRESHOLD", "400.5"));
+  TEST_ASSERT_EQUAL(PS_OUT_OF_RANGE, reg.set("DETECTION_THRESHOLD", "nan"));
+  TEST_ASSERT_FALSE(reg.hasPending());
+}
+
+void test_set_is_staged_until_apply(void) {
+  TEST_ASSERT_EQUAL(PS_OK, reg.set("detection_threshold", "82.5"));  // Case-insensitive
+  TEST_ASSERT_TRUE(reg.hasPending());
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 70.0f, gThreshold);
+  TEST_ASSERT_EQUAL(1, reg.applyPending());
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 82.5f, gThreshold);
+  TEST_ASSERT_FALSE(reg.hasPending());
+  TEST_ASSERT_EQUAL(0, reg.applyPending());
+}
+
+void test_protocol_replies(void) {
+  TEST_ASSERT_EQUAL_STRING("OK BIN2_MAX_G=200", run("get bin2_max_g\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("ERR unknown parameter", run("get X\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("OK BIN2_MAX_G=300 (pending)", run("set BIN2_MAX_G 300\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("ERR out of range 1..5000", run("set BIN2_MAX_G 0\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("ERR bad value", run("set BIN2_MAX_G\n").c_str());
+
+  run("list\n");
+  TEST_ASSERT_EQUAL(4, lines.size());
+  TEST_ASSERT_EQUAL_STRING("DETECTION_THRESHOLD=70.000 [10..400]", lines[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("BIN2_MAX_G=200 [1..5000] (pending)", lines[2].c_str());
+  TEST_ASSERT_EQUAL_STRING("OK", lines[3].c_str());
+
+  // Not a parameter command: left to the caller
+  TEST_ASSERT_TRUE(feedLine("stats\n"));
+  TEST_ASSERT_FALSE(handleParamCommand(reg, cmd, collect));
+}
+
+void test_defaults_restore(void) {
+  reg.set("BIN1_MAX_G", "80");
+  reg.applyPending();
+  TEST_ASSERT_EQUAL_INT(80, gBin1);
+  TEST_ASSERT_EQUAL_STRING("OK defaults (pending)", run("defaults\n").c_str());
+  reg.applyPending();
+  TEST_ASSERT_EQUAL_INT(50, gBin1);
+}
+
+// Order of the sets does not matter, only the staged set as a whole
+void test_cross_check_whole_set(void) {
+  reg.set("BIN1_MAX_G", "300");  // Alone this breaks BIN1 < BIN2 ...
+  reg.set("BIN2_MAX_G", "500");  // ... together it is fine
+  TEST_ASSERT_FLOAT_WITHIN(0, 300.0f, reg.stagedFloat("BIN1_MAX_G"));
+  TEST_ASSERT_EQUAL(2, reg.applyPending());
+  TEST_ASSERT_NULL(reg.rejectReason());
+  TEST_ASSERT_EQUAL_INT(300, gBin1);
+  TEST_ASSERT_EQUAL_INT(500, gBin2);
+}
+
+void test_cross_check_rejects_all(void) {
+  reg.set("DETECTION_THRESHOLD", "90");
+  reg.set("BIN2_MAX_G", "40");  // Below BIN1_MAX_G = 50
+  TEST_ASSERT_EQUAL(0, reg.applyPending());
+  TEST_ASSERT_EQUAL_STRING("bins", reg.rejectReason());
+  TEST_ASSERT_FALSE(reg.hasPending());
+  TEST_ASSERT_EQUAL_INT(200, gBin2);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 70.0f, gThreshold);  // Not half-applied
+  TEST_ASSERT_TRUE(reg.stagedFloat("NOPE") != reg.stagedFloat("NOPE"));  // NaN
+}
+
+void test_nvs_key(void) {
+  char a[16];
+  char b[16];
+  ParamRegistry::nvsKey("DETECTION_THRESHOLD", a, sizeof(a));
+  ParamRegistry::nvsKey("DETECTION_THRESHOLE", b, sizeof(b));
+  TEST_ASSERT_EQUAL(9, strlen(a));  // NVS keys are at most 15 chars
+  TEST_ASSERT_TRUE(strcmp(a, b) != 0);
+}
+
+// Past MAX_PARAMS add*() fails and the first name left out is kept
+void test_add_full(void) {
+  ParamRegistry r;
+  static int v[ParamRegistry::MAX_PARAMS + 2];
+  static char names[ParamRegistry::MAX_PARAMS + 2][8];
+  for (size_t i = 0; i < ParamRegistry::MAX_PARAMS; i++) {
+    snprintf(names[i], sizeof(names[i]), "P%u", (unsigned)i);
+    TEST_ASSERT_EQUAL(PS_OK, r.addInt(names[i], &v[i], 0, 10));
+  }
+  TEST_ASSERT_NULL(r.addFailed());
+  TEST_ASSERT_EQUAL(PS_FULL, r.addInt("LATE1", &v[ParamRegistry::MAX_PARAMS], 0, 10));
+  TEST_ASSERT_EQUAL(PS_FULL, r.addInt("LATE2", &v[ParamRegistry::MAX_PARAMS + 1], 0, 10));
+  TEST_ASSERT_EQUAL_STRING("LATE1", r.addFailed());
+  TEST_ASSERT_EQUAL(ParamRegistry::MAX_PARAMS, r.count());
+  TEST_ASSERT_EQUAL(PS_UNKNOWN, r.set("LATE1", "1"));
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_line_tokens);
+  RUN_TEST(test_line_too_many_args);
+  RUN_TEST(test_line_overflow_dropped);
+  RUN_TEST(test_set_parse_errors);
+  RUN_TEST(test_set_is_staged_until_apply);
+  RUN_TEST(test_protocol_replies);
+  RUN_TEST(test_defaults_restore);
+  RUN_TEST(test_cross_check_whole_set);
+  RUN_TEST(test_cross_check_rejects_all);
+  RUN_TEST(test_nvs_key);
+  RUN_TEST(test_add_full);
+  return UNITY_END();
+}
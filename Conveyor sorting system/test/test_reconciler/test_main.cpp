@@ -0,0 +1,168 @@
+// Host tests for the weight / detection Reconciler (pio test -e native).
+#include <unity.h>
+
+#include "Reconciler.h"
+
+static Reconciler rec;
+static uint32_t nowMs;
+
+static bool weight(uint16_t seq, int32_t grams, bool unverified = false) {
+  PendingWeight w = {};
+  w.seq = seq;
+  w.weightMg = grams * 1000;
+  w.unverified = unverified;
+  w.arrivalMs = nowMs;
+  return rec.onWeight(w);
+}
+
+// Detection; returns the matched grams, -1 for a lost frame, -2 for an
+// orphan, -3 for an unverified weight
+static int32_t detect() {
+  nowMs += 500;
+  PendingWeight out;
+  ReconResult rr = rec.onDetection(nowMs, out);
+  if (rr == RR_LOST_FRAME) return -1;
+  if (rr == RR_ORPHAN) return -2;
+  if (rr == RR_UNVERIFIED) return -3;
+  return out.weightMg / 1000;
+}
+
+void setUp(void) {
+  rec = Reconciler();
+  rec.setTimeoutMs(15000);
+  nowMs = 1000;
+}
+
+void tearDown(void) {}
+
+void test_fifo_order(void) {
+  weight(1, 10);
+  weight(2, 20);
+  weight(3, 30);
+  TEST_ASSERT_EQUAL_INT(10, detect());
+  TEST_ASSERT_EQUAL_INT(20, detect());
+  TEST_ASSERT_EQUAL_INT(30, detect());
+  TEST_ASSERT_EQUAL_INT(-2, detect());
+  TEST_ASSERT_EQUAL_UINT32(3, rec.counters().matched);
+  TEST_ASSERT_EQUAL_UINT32(1, rec.counters().orphans);
+}
+
+// An untrusted WIM estimate keeps its seq: only its own product is rejected
+void test_unverified_keeps_order(void) {
+  weight(1, 10);
+  weight(2, 20, true);
+  weight(3, 30);
+  TEST_ASSERT_EQUAL_INT(10, detect());
+  TEST_ASSERT_EQUAL_INT(-3, detect());
+  TEST_ASSERT_EQUAL_INT(30, detect());
+  TEST_ASSERT_EQUAL_UINT32(3, rec.counters().weights);
+  TEST_ASSERT_EQUAL_UINT32(1, rec.counters().unverified);
+  TEST_ASSERT_EQUAL_UINT32(0, rec.counters().seqGaps);
+}
+
+// Frame N lost, frame N+1 arrives before product N reaches the SR04
+void test_gap_before_product(void) {
+  weight(1, 10);
+  weight(3, 30);
+  TEST_ASSERT_EQUAL_INT(10, detect());
+  TEST_ASSERT_EQUAL_INT(-1, detect());  // Product 2: rejected, not given 30 g
+  TEST_ASSERT_EQUAL_INT(30, detect());
+  TEST_ASSERT_EQUAL_UINT32(1, rec.counters().seqGaps);
+  TEST_ASSERT_EQUAL_UINT32(1, rec.counters().lostMatched);
+}
+
+// Frame N lost, product N passes as an orphan, then frame N+1 arrives
+void test_gap_after_orphan(void) {
+  weight(1, 10);
+  TEST_ASSERT_EQUAL_INT(10, detect());
+  TEST_ASSERT_EQUAL_INT(-2, detect());  // Product 2, frame 2 lost
+  weight(3, 30);
+  weight(4, 40);
+  TEST_ASSERT_EQUAL_INT(30, detect());  // No placeholder in front of it
+  TEST_ASSERT_EQUAL_INT(40, detect());
+  TEST_ASSERT_EQUAL_UINT32(1, rec.counters().seqGaps);
+  TEST_ASSERT_EQUAL_UINT32(1, rec.counters().lostOrphaned);
+  TEST_ASSERT_EQUAL_UINT32(0, rec.counters().lostMatched);
+  TEST_ASSERT_EQUAL(0, rec.pending());
+}
+
+// Two frames lost, only the first product already passed
+void test_gap_partly_orphaned(void) {
+  weight(1, 10);
+  TEST_ASSERT_EQUAL_INT(10, detect());
+  TEST_ASSERT_EQUAL_INT(-2, detect());  // Product 2
+  weight(4, 40);                        // Frames 2 and 3 lost
+  TEST_ASSERT_EQUAL_INT(-1, detect());  // Product 3
+  TEST_ASSERT_EQUAL_INT(40, detect());
+}
+
+// An orphan from long ago (object put on the belt) is not a lost frame
+void test_stale_orphan_ignored(void) {
+  TEST_ASSERT_EQUAL_INT(-2, detect());
+  weight(1, 10);
+  TEST_ASSERT_EQUAL_INT(10, detect());
+  nowMs += 20000;
+  TEST_ASSERT_EQUAL_INT(-2, detect());  // Would-be credit ...
+  nowMs += 20000;
+  weight(3, 30);                        // ... too old for this gap
+  TEST_ASSERT_EQUAL_INT(-1, detect());
+  TEST_ASSERT_EQUAL_INT(30, detect());
+}
+
+// A received weight ends the orphans' chance to be a lost frame
+void test_credit_reset_by_weight(void) {
+  weight(1, 10);
+  TEST_ASSERT_EQUAL_INT(10, detect());
+  TEST_ASSERT_EQUAL_INT(-2, detect());  // Foreign object
+  weight(2, 20);                        // No gap: credit dropped
+  weight(4, 40);                        // Frame 3 lost, product 3 not seen yet
+  TEST_ASSERT_EQUAL_INT(20, detect());
+  TEST_ASSERT_EQUAL_INT(-1, detect());
+  TEST_ASSERT_EQUAL_INT(40, detect());
+}
+
+void test_duplicates_and_restart(void) {
+  weight(5, 50);
+  TEST_ASSERT_FALSE(weight(5, 50));
+  TEST_ASSERT_FALSE(weight(4, 40));
+  TEST_ASSERT_EQUAL_UINT32(2, rec.counters().duplicates);
+  TEST_ASSERT_TRUE(weight(1, 10));  // Sender rebooted (HELLO missed)
+  TEST_ASSERT_EQUAL_UINT32(0, rec.counters().seqGaps);
+  TEST_ASSERT_EQUAL_INT(50, detect());
+  TEST_ASSERT_EQUAL_INT(10, detect());
+}
+
+void test_large_jump_not_queued(void) {
+  weight(1, 10);
+  weight(1 + Reconciler::MAX_GAP + 5, 99);
+  TEST_ASSERT_EQUAL(2, rec.pending());
+  TEST_ASSERT_EQUAL_UINT32(Reconciler::MAX_GAP + 4, rec.counters().seqGaps);
+}
+
+void test_expire_and_overflow(void) {
+  weight(1, 10);
+  nowMs += 16000;
+  TEST_ASSERT_EQUAL(1, rec.expire(nowMs));
+  TEST_ASSERT_EQUAL(0, rec.pending());
+  for (uint16_t s = 2; s < 2 + Reconciler::CAPACITY + 3; s++) weight(s, s);
+  TEST_ASSERT_EQUAL(Reconciler::CAPACITY, rec.pending());
+  TEST_ASSERT_EQUAL_UINT32(3, rec.counters().overflow);
+  TEST_ASSERT_EQUAL_INT(5, detect());  // Oldest three dropped
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_order);
+  RUN_TEST(test_gap_before_product);
+  RUN_TEST(test_unverified_keeps_order);
+  RUN_TEST(test_gap_after_orphan);
+  RUN_TEST(test_gap_partly_orphaned);
+  RUN_TEST(test_stale_orphan_ignored);
+  RUN_TEST(test_credit_reset_by_weight);
+  RUN_TEST(test_duplicates_and_restart);
+  RUN_TEST(test_large_jump_not_queued);
+  RUN_TEST(test_expire_and_overflow);
+  return UNITY_END();
+}
@@ -0,0 +1,287 @@
+// Host tests for the trace replay (pio test -e native): synthetic traces
+// are fed through the native build of src/main.cpp.
+#include <unity.h>
+
+#include <FastAccelStepper.h>
+#include <LiquidCrystal_I2C.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DumpFrame.h"
+#include "HostSim.h"
+#include "NowLink.h"
+#include "SortLedger.h"
+#include "SortStats.h"
+#include "TraceReplay.h"
+
+extern SortLedger sortLedger;  // src/main.cpp
+extern LiquidCrystal_I2C* lcd;
+extern SortStats sortStats;
+extern int productCount;
+void updateLCD();
+
+#define FAR_MM10  2000  // 200 mm: belt empty
+#define NEAR_MM10 500   // 50 mm: product under the SR04
+#define PASS_US   12000 // loop() period of the recorded run
+
+// Builds a trace the way Module 2 records it: one TR_SR04 per loop() pass.
+struct TraceBuilder {
+  std::vector<TraceRecord> recs;
+  uint32_t tUs = 0;
+
+  void add(uint8_t kind, uint8_t arg, int32_t value) {
+    TraceRecord r;
+    r.tUs = tUs;
+    r.kind = kind;
+    r.arg = arg;
+    r.value = value;
+    recs.push_back(r);
+  }
+  void passes(int n, int32_t mm10) {
+    for (int i = 0; i < n; i++) {
+      tUs += PASS_US;
+      add(TR_SR04, 0, mm10);
+    }
+  }
+  void weight(uint16_t seq, int32_t mg, uint8_t type = LM_WEIGHT) {
+    tUs += 1000;
+    add(TR_NOW_RX, type, mg);
+    add(TR_NOW_SEQ, type, seq);
+  }
+  // Default gap outlasts SORT_HOLD_MS, so each diverter hold runs out
+  void product(int gapPasses = 400) {
+    passes(5, NEAR_MM10);
+    passes(gapPasses, FAR_MM10);  // > COUNT_COOLDOWN in any case
+  }
+};
+
+static uint32_t replayAll(const TraceBuilder& tb) {
+  TraceReplay replay;
+  replay.begin(tb.recs.data(), tb.recs.size());
+  while (replay.step()) {
+  }
+  return replay.loops();
+}
+
+static LedgerEntry ledgerAt(uint64_t idx) {
+  LedgerEntry e;
+  TEST_ASSERT_TRUE(sortLedger.get(idx, e));
+  return e;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Framed dump with log lines and a repeated frame in between
+void test_load_capture(void) {
+  std::vector<TraceRecord> recs;
+  for (int i = 0; i < 100; i++) {
+    TraceRecord r = {(uint32_t)(i * 1000), TR_SR04, 0, i == 7 ? 0 : -i};
+    recs.push_back(r);
+  }
+  const uint8_t* bytes = (const uint8_t*)recs.data();
+  size_t total = recs.size() * sizeof(TraceRecord);
+
+  std::string cap = "boot log\r\nTRACE BEGIN 100 10 0\r\n";
+  uint8_t frame[DUMP_FRAME_MAX];
+  for (size_t off = 0; off < total; off += DUMP_FRAME_MAX_DATA) {
+    size_t n = total - off < DUMP_FRAME_MAX_DATA ? total - off : DUMP_FRAME_MAX_DATA;
+    std::string f((const char*)frame, dumpFrameEncode((uint32_t)off, bytes + off, n, frame));
+    cap += f;
+    cap += ">>> Product detected! Count: 3\r\n";
+    if (off == 0) cap += f;
+  }
+  cap += "\r\nTRACE END\r\n";
+
+  const char* path = "test_replay_capture.bin";
+  FILE* fp = fopen(path, "wb");
+  TEST_ASSERT_NOT_NULL(fp);
+  fwrite(cap.data(), 1, cap.size(), fp);
+  fclose(fp);
+
+  std::vector<TraceRecord> got;
+  TEST_ASSERT_TRUE(loadTraceCapture(path, got));
+  remove(path);
+  TEST_ASSERT_EQUAL(recs.size(), got.size());
+  TEST_ASSERT_EQUAL_INT(0, memcmp(recs.data(), got.data(), total));
+}
+
+// Matched, lost-frame and missing weights end up in the ledger as recorded
+void test_replay_sorts_products(void) {
+  TraceBuilder tb;
+  tb.passes(10, FAR_MM10);
+  tb.weight(1, 30000);  // Belt auto-starts
+  tb.passes(50, FAR_MM10);
+  tb.product();
+  tb.weight(2, 150000);
+  tb.product();
+  tb.weight(4, 500000);  // Seq 3 lost on air
+  tb.product();
+  tb.product();
+  tb.product();  // No weight at all
+
+  uint64_t first = sortLedger.total();
+  uint32_t loops = replayAll(tb);
+  TEST_ASSERT_EQUAL_UINT32(10 + 50 + 5 * 405, loops);
+  TEST_ASSERT_EQUAL_UINT32(5, (uint32_t)(sortLedger.total() - first));
+
+  LedgerEntry e = ledgerAt(first);
+  TEST_ASSERT_EQUAL_UINT8(LO_SORTED_LINK, e.outcome);
+  TEST_ASSERT_EQUAL_UINT8(1, e.bin);
+  TEST_ASSERT_EQUAL_INT32(30000, e.weightMg);
+  e = ledgerAt(first + 1);
+  TEST_ASSERT_EQUAL_UINT8(LO_SORTED_LINK, e.outcome);
+  TEST_ASSERT_EQUAL_UINT8(2, e.bin);
+  e = ledgerAt(first + 2);
+  TEST_ASSERT_EQUAL_UINT8(LO_REJECT_LOST_FRAME, e.outcome);
+  TEST_ASSERT_EQUAL_UINT8(3, e.bin);
+  e = ledgerAt(first + 3);
+  TEST_ASSERT_EQUAL_UINT8(LO_SORTED_LINK, e.outcome);
+  TEST_ASSERT_EQUAL_INT32(500000, e.weightMg);
+  e = ledgerAt(first + 4);
+  TEST_ASSERT_EQUAL_UINT8(LO_REJECT_NO_WEIGHT, e.outcome);
+}
+
+// Next product arrives during the hold: the held one is flagged only if
+// the diverter has to move for the new one, and the LCD keeps showing
+// the new product's decision
+void test_replay_preempted_hold(void) {
+  TraceBuilder tb;
+  tb.weight(1, 30000);  // Module 1 restarted: a new sequence
+  tb.weight(2, 40000);
+  tb.weight(3, 150000);
+  tb.passes(20, FAR_MM10);
+  tb.product(60);  // Bin 1
+  tb.product(60);  // Bin 1 as well: hold just continues
+  tb.passes(5, NEAR_MM10);  // Bin 2 while bin 1 is held
+  tb.passes(5, FAR_MM10);
+
+  uint64_t first = sortLedger.total();
+  replayAll(tb);
+  TEST_ASSERT_NOT_NULL(lcd);
+  TEST_ASSERT_EQUAL_STRING("Sorting: BIN 2  ", lcd->line(0));
+
+  TraceBuilder rest;
+  rest.passes(400, FAR_MM10);  // Let the hold run out
+  replayAll(rest);
+  TEST_ASSERT_EQUAL_UINT32(3, (uint32_t)(sortLedger.total() - first));
+  TEST_ASSERT_EQUAL_UINT8(LO_SORTED_LINK, ledgerAt(first).outcome);
+  TEST_ASSERT_EQUAL_UINT8(LO_UNVERIFIED_PREEMPTED, ledgerAt(first + 1).outcome);
+  TEST_ASSERT_EQUAL_UINT8(1, ledgerAt(first + 1).bin);
+  TEST_ASSERT_EQUAL_UINT8(LO_SORTED_LINK, ledgerAt(first + 2).outcome);
+}
+
+// An LM_UNVERIFIED frame rejects its own product only
+void test_replay_unverified_rejected(void) {
+  TraceBuilder tb;
+  tb.weight(4, 30000);  // Continues the sequence of the test before
+  tb.weight(5, 35000, LM_UNVERIFIED);
+  tb.weight(6, 40000);
+  tb.passes(20, FAR_MM10);
+  tb.product();
+  tb.product();
+  tb.product();
+
+  uint64_t first = sortLedger.total();
+  replayAll(tb);
+  TEST_ASSERT_EQUAL_UINT32(3, (uint32_t)(sortLedger.total() - first));
+  TEST_ASSERT_EQUAL_UINT8(LO_SORTED_LINK, ledgerAt(first).outcome);
+  LedgerEntry e = ledgerAt(first + 1);
+  TEST_ASSERT_EQUAL_UINT8(LO_REJECT_UNVERIFIED, e.outcome);
+  TEST_ASSERT_EQUAL_UINT8(3, e.bin);  // REJECT_BIN
+  TEST_ASSERT_EQUAL_INT32(35000, e.weightMg);
+  TEST_ASSERT_EQUAL_UINT8(LO_SORTED_LINK, ledgerAt(first + 2).outcome);
+  TEST_ASSERT_EQUAL_INT32(40000, ledgerAt(first + 2).weightMg);
+}
+
+// A recorded STOP press stops the belt; products after that are not counted
+void test_replay_stop_button(void) {
+  TraceBuilder tb;
+  tb.passes(5, FAR_MM10);
+  tb.add(TR_BUTTON, 5, LOW);  // BTN_STOP
+  tb.passes(5, FAR_MM10);
+  tb.add(TR_BUTTON, 5, HIGH);
+  tb.passes(200, FAR_MM10);  // S-curve down to 0
+  tb.product();
+
+  uint64_t first = sortLedger.total();
+  replayAll(tb);
+  TEST_ASSERT_FALSE(hostStepper->isRunning());
+  TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)(sortLedger.total() - first));
+}
+
+// Step rate as sampled by HostSim (every simulated millisecond, shorter
+// where a wait ends mid-millisecond)
+static std::vector<std::pair<uint64_t, double> > stepHz;
+static void probeRate(uint64_t tUs, double hz) { stepHz.push_back(std::make_pair(tUs, hz)); }
+
+// START, then STOP while the belt is still speeding up: the step rate's
+// acceleration changes by no more than the jerk limit allows per loop()
+// pass (the stepper ramps at the profile's accel averaged over a pass).
+void test_replay_belt_step_rate(void) {
+  TraceBuilder tb;
+  tb.passes(5, FAR_MM10);
+  tb.add(TR_BUTTON, 4, LOW);  // BTN_START
+  tb.passes(5, FAR_MM10);
+  tb.add(TR_BUTTON, 4, HIGH);
+  tb.passes(3, FAR_MM10);
+  tb.add(TR_BUTTON, 5, LOW);  // BTN_STOP, released about 100 ms into the start
+  tb.passes(5, FAR_MM10);
+  tb.add(TR_BUTTON, 5, HIGH);
+  tb.passes(100, FAR_MM10);
+
+  stepHz.clear();
+  hostSetStepperProbe(probeRate);
+  replayAll(tb);
+  hostSetStepperProbe(nullptr);
+  TEST_ASSERT_FALSE(hostStepper->isRunning());
+
+  const double jerk = 300000, accel = 30000;  // JERK_STEPS_S3, ACCEL_STEPS_S2
+  const double tick = PASS_US * 1e-6;
+  double peakHz = 0, maxAccel = 0, maxJump = 0, lastA = 0;
+  for (size_t i = 1; i < stepHz.size(); i++) {
+    double dt = (stepHz[i].first - stepHz[i - 1].first) * 1e-6;
+    if (dt <= 0) continue;
+    double a = (stepHz[i].second - stepHz[i - 1].second) / dt;
+    peakHz = fmax(peakHz, stepHz[i].second);
+    maxAccel = fmax(maxAccel, fabs(a));
+    maxJump = fmax(maxJump, fabs(a - lastA));
+    lastA = a;
+  }
+  TEST_ASSERT_TRUE(peakHz > 500);  // Stopped mid-start, well below 3500
+  TEST_ASSERT_TRUE(peakHz < 3000);
+  TEST_ASSERT_TRUE(maxAccel <= accel * 1.01);
+  TEST_ASSERT_TRUE(maxJump <= 2 * jerk * tick + 200);  // + BELT_MIN_ACCEL
+}
+
+// Large count and a 3-digit rate: the rate still fits in 16 columns
+void test_lcd_stats_line_fits(void) {
+  int saved = productCount;
+  productCount = 12345;
+  sortStats.clear();  // Products of the tests before are in the window
+  for (int i = 0; i < 150; i++) sortStats.addRejected(millis());
+  updateLCD();
+  TEST_ASSERT_EQUAL_STRING("N:12345 150/m   ", lcd->line(0));
+
+  productCount = 42;
+  updateLCD();
+  TEST_ASSERT_EQUAL_STRING("Count:42 150/m  ", lcd->line(0));
+  productCount = saved;
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_load_capture);
+  RUN_TEST(test_replay_sorts_products);  // Runs setup(), the belt stays on
+  RUN_TEST(test_replay_preempted_hold);
+  RUN_TEST(test_replay_unverified_rejected);
+  RUN_TEST(test_replay_stop_button);
+  RUN_TEST(test_replay_belt_step_rate);
+  RUN_TEST(test_lcd_stats_line_fits);
+  return UNITY_END();
+}
@@ -0,0 +1,130 @@
+// Host tests for SortStats (pio test -e native): Welford accuracy over
+// long runs, histogram edges and the items/min windows.
+#include <unity.h>
+
+#include <math.h>
+#include <stdint.h>
+
+#include "SortStats.h"
+
+#define LONG_RUN 5000000  // About a year of products on one line
+
+// Deterministic normal samples (LCG + Box-Muller)
+struct Gauss {
+  uint64_t s = 12345;
+  double uniform() {
+    s = s * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((s >> 11) + 0.5) / 9007199254740992.0;  // (0, 1)
+  }
+  double next(double mean, double sd) {
+    return mean + sd * sqrt(-2.0 * log(uniform())) * cos(6.283185307179586 * uniform());
+  }
+};
+
+// Two-pass reference in long double
+static void reference(double mean, double sd, long double& m, long double& var) {
+  Gauss g;
+  long double sum = 0;
+  for (int i = 0; i < LONG_RUN; i++) sum += g.next(mean, sd);
+  m = sum / LONG_RUN;
+  Gauss g2;
+  long double ss = 0;
+  for (int i = 0; i < LONG_RUN; i++) {
+    long double d = g2.next(mean, sd) - m;
+    ss += d * d;
+  }
+  var = ss / (LONG_RUN - 1);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_welford_long_run(void) {
+  RunningStats rs;
+  Gauss g;
+  for (int i = 0; i < LONG_RUN; i++) rs.add(g.next(180.0, 2.5));
+  long double m, var;
+  reference(180.0, 2.5, m, var);
+  TEST_ASSERT_EQUAL_UINT32(LONG_RUN, rs.count());
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9 * 180.0, (double)m, rs.mean());
+  TEST_ASSERT_DOUBLE_WITHIN(1e-7 * var, (double)var, rs.variance());
+}
+
+// Large offset, tiny spread: sum / sum-of-squares would cancel to noise
+void test_welford_large_offset(void) {
+  RunningStats rs;
+  for (int i = 0; i < LONG_RUN; i++) rs.add(1e9 + (i % 10));
+  // Values 0..9 repeated: population variance 8.25
+  double expect = 8.25 * LONG_RUN / (LONG_RUN - 1.0);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 1e9 + 4.5, rs.mean());
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6 * expect, expect, rs.variance());
+  TEST_ASSERT_DOUBLE_WITHIN(0, 1e9, rs.min());
+  TEST_ASSERT_DOUBLE_WITHIN(0, 1e9 + 9, rs.max());
+}
+
+void test_welford_small_counts(void) {
+  RunningStats rs;
+  TEST_ASSERT_DOUBLE_WITHIN(0, 0.0, rs.variance());
+  rs.add(42.0);
+  TEST_ASSERT_DOUBLE_WITHIN(0, 0.0, rs.variance());
+  TEST_ASSERT_DOUBLE_WITHIN(0, 42.0, rs.mean());
+  rs.add(44.0);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-12, 2.0, rs.variance());
+  rs.clear();
+  TEST_ASSERT_EQUAL_UINT32(0, rs.count());
+}
+
+void test_histogram_edges(void) {
+  Histogram h;
+  h.configure(0, 51);  // Bin 1 of the default thresholds: [0..51)
+  h.add(-0.001);
+  h.add(0);
+  h.add(50.999);
+  h.add(51);
+  TEST_ASSERT_EQUAL_UINT32(1, h.under());
+  TEST_ASSERT_EQUAL_UINT32(1, h.bucket(0));
+  TEST_ASSERT_EQUAL_UINT32(1, h.bucket(Histogram::BUCKETS - 1));
+  TEST_ASSERT_EQUAL_UINT32(1, h.over());
+  h.configure(10, 10);  // Empty range is widened, not divided by zero
+  h.add(10);
+  TEST_ASSERT_EQUAL_UINT32(1, h.bucket(0));
+}
+
+void test_rate_window(void) {
+  RateWindow w;
+  w.begin(1000);
+  uint32_t t = 0xFFFFF000u;  // millis() wraps during the test
+  for (int i = 0; i < 120; i++) {
+    w.add(t);
+    t += 500;  // 2 items/s
+  }
+  TEST_ASSERT_UINT32_WITHIN(2, 120, w.count(t));
+  TEST_ASSERT_UINT32_WITHIN(2, 60, w.count(t + 30000));
+  TEST_ASSERT_EQUAL_UINT32(0, w.count(t + 61000));
+}
+
+void test_sort_stats_bins(void) {
+  SortStats st;
+  st.begin();
+  st.configureBin(1, 0, 51);
+  st.addSorted(1, 30.0, 1000);
+  st.addSorted(1, 40.0, 1100);
+  st.addRejected(1200);
+  TEST_ASSERT_EQUAL_UINT32(2, st.stats(1).count());
+  TEST_ASSERT_DOUBLE_WITHIN(1e-12, 35.0, st.stats(1).mean());
+  TEST_ASSERT_EQUAL_UINT32(1, st.rejected());
+  TEST_ASSERT_EQUAL_UINT32(3, st.perMinute(1300));
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_welford_long_run);
+  RUN_TEST(test_welford_large_offset);
+  RUN_TEST(test_welford_small_counts);
+  RUN_TEST(test_histogram_edges);
+  RUN_TEST(test_rate_window);
+  RUN_TEST(test_sort_stats_bins);
+  return UNITY_END();
+}
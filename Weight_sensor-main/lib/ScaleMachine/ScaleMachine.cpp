@@ -0,0 +1,98 @@
+#include "ScaleMachine.h"
+
+// ---------------- SampleWindow ----------------
+
+void SampleWindow::add(float g) {
+  buf_[next_] = g;
+  next_ = (next_ + 1 == SIZE) ? 0 : next_ + 1;
+  if (count_ < SIZE) count_++;
+}
+
+float SampleWindow::mean(size_t n) const {
+  if (n > count_) n = count_;
+  if (n == 0) return 0.0f;
+  float sum = 0.0f;
+  size_t i = next_;
+  for (size_t k = 0; k < n; k++) {
+    i = (i == 0) ? SIZE - 1 : i - 1;
+    sum += buf_[i];
+  }
+  return sum / n;
+}
+
+// ---------------- ScaleMachine ----------------
+
+void ScaleMachine::enter(ScaleState s, ScaleOutput& out) {
+  state_ = s;
+  out.stateChanged = true;
+}
+
+ScaleOutput ScaleMachine::onSample(float grams, uint32_t nowMs) {
+  ScaleOutput out = {};
+  window_.add(grams);
+
+  switch (state_) {
+    case CONNECTING:
+      break;
+
+    case WAITING:
+      if (window_.mean(5) > cfg_.triggerG) {
+        measureStartMs_ = nowMs;
+        measureSamples_ = 0;
+        enter(MEASURING, out);
+      }
+      break;
+
+    case MEASURING:
+      measureSamples_++;
+      if (nowMs - measureStartMs_ >= cfg_.measureMs) {
+        // Final value: up to 10 samples, all taken while measuring
+        size_t n = (measureSamples_ < SampleWindow::SIZE) ? measureSamples_ : SampleWindow::SIZE;
+        finalG_ = window_.mean(n);
+        resultMs_ = nowMs;
+        pushing_ = true;
+        pushStarted_ = false;
+        below_ = false;
+        enter(DISPLAYING, out);
+      }
+      break;
+
+    case DISPLAYING:
+      if (pushing_ && !pushStarted_ && nowMs - resultMs_ >= cfg_.displayMs) {
+        pushStarted_ = true;
+        out.sendWeight = true;
+        out.startPush = true;
+        out.weightG = finalG_;
+      }
+      if (pushing_) break;
+      if (window_.mean(5) < cfg_.removeG) {
+        if (!below_) {
+          below_ = true;
+          belowSinceMs_ = nowMs;
+        } else if (nowMs - belowSinceMs_ >= cfg_.removeConfirmMs) {
+          enter(WAITING, out);
+        }
+      } else {
+        below_ = false;
+      }
+      break;
+  }
+  return out;
+}
+
+void ScaleMachine::onConnected() {
+  if (state_ == CONNECTING) state_ = WAITING;
+}
+
+void ScaleMachine::onPushDone() {
+  if (!pushStarted_) return;  // Nothing was pushed yet
+  pushing_ = false;
+  below_ = false;
+}
+
+void ScaleMachine::onTared() {
+  window_.clear();
+  if (state_ == WAITING || (state_ == DISPLAYING && !pushing_)) {
+    state_ = WAITING;
+  }
+}
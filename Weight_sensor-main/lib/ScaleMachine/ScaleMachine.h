@@ -0,0 +1,94 @@
+/************************************************************
+ * ScaleMachine - Weighing state machine of Module 1
+ *
+ * Pure logic, driven by one call per HX711 sample: no HX711,
+ * LCD, servo or FreeRTOS calls in here. The tasks in main.cpp
+ * feed it samples and carry out what the returned ScaleOutput
+ * asks for (send the weight, start the pusher); the pusher
+ * reports back with onPushDone().
+ *
+ *   CONNECTING --onConnected--> WAITING --avg(5) > trigger-->
+ *   MEASURING --measureMs--> DISPLAYING --displayMs: send +
+ *   push--> onPushDone, avg(5) < remove for removeConfirmMs
+ *   --> WAITING
+ *
+ * As in the original loop(): the result is shown for displayMs,
+ * then sent and pushed. From the end of MEASURING until the
+ * push is done pushing() is true: no new trigger, no tare.
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum ScaleState : uint8_t {
+  CONNECTING,
+  WAITING,
+  MEASURING,
+  DISPLAYING
+};
+
+struct ScaleConfig {
+  float triggerG;            // Start measuring above this
+  float removeG;             // Scale counts as empty below this
+  uint32_t measureMs;        // Settle time before the final reading
+  uint32_t removeConfirmMs;  // Must stay empty this long
+  uint32_t displayMs;        // Result shown before it is sent and pushed
+};
+
+// What the caller has to do after a step
+struct ScaleOutput {
+  bool stateChanged;
+  bool sendWeight;   // Final weight ready: weightG
+  bool startPush;    // Push the product onto the conveyor
+  float weightG;
+};
+
+// Mean of the last N samples (N <= SampleWindow::SIZE)
+class SampleWindow {
+public:
+  static const size_t SIZE = 10;
+
+  void add(float g);
+  void clear() { count_ = 0; }
+  size_t count() const { return count_; }
+  float mean(size_t n) const;
+
+private:
+  float buf_[SIZE];
+  size_t next_ = 0;
+  size_t count_ = 0;
+};
+
+class ScaleMachine {
+public:
+  void setConfig(const ScaleConfig& cfg) { cfg_ = cfg; }
+
+  ScaleOutput onSample(float grams, uint32_t nowMs);
+  void onConnected();
+  void onPushDone();
+  // After a tare: old samples no longer mean anything
+  void onTared();
+
+  ScaleState state() const { return state_; }
+  bool pushing() const { return pushing_; }  // Includes the display time
+  float finalG() const { return finalG_; }
+  float liveG() const { return window_.mean(5); }
+
+private:
+  void enter(ScaleState s, ScaleOutput& out);
+
+  ScaleConfig cfg_ = {30.0f, 10.0f, 3000, 500, 2000};
+  ScaleState state_ = CONNECTING;
+  SampleWindow window_;
+  uint32_t measureStartMs_ = 0;
+  size_t measureSamples_ = 0;   // Samples since MEASURING started
+  uint32_t resultMs_ = 0;       // DISPLAYING entered
+  bool pushing_ = false;
+  bool pushStarted_ = false;    // Weight sent, pusher started
+  bool below_ = false;          // Under removeG since belowSinceMs_
+  uint32_t belowSinceMs_ = 0;
+  float finalG_ = 0.0f;
+};
@@ -0,0 +1,239 @@
+#include "WeighInMotion.h"
+
+#include <math.h>
+
+// ---------------- WimCapture ----------------
+
+void WimCapture::reset() {
+  n_ = pre_ = 0;
+  ringN_ = ringNext_ = 0;
+  capturing_ = truncated_ = false;
+  below_ = 0;
+  waitRelease_ = false;
+  zero_ = 0.0f;
+}
+
+bool WimCapture::add(const WimSample& s) {
+  if (!capturing_) {
+    if (waitRelease_) {
+      // After a truncated capture: the same item is still on the platform
+      if (s.g >= cfg_.releaseG) return false;
+      waitRelease_ = false;
+    }
+    if (s.g > cfg_.triggerG) {
+      // Baseline samples first, oldest first
+      n_ = 0;
+      for (size_t k = 0; k < ringN_; k++) {
+        size_t i = (ringNext_ + PRE_SAMPLES - ringN_ + k) % PRE_SAMPLES;
+        buf_[n_++] = ring_[i];
+      }
+      pre_ = n_;
+      buf_[n_++] = s;
+      capturing_ = true;
+      truncated_ = false;
+      below_ = 0;
+      return false;
+    }
+    // Idle: follow slow drift, but not a slow item's ramp tails (a
+    // 5 g band let them pull the zero up by over 1 g at 100 mm/s)
+    if (fabsf(s.g - zero_) < 0.2f * cfg_.releaseG) {
+      zero_ += (s.g - zero_) / (1 << ZERO_SHIFT);
+    }
+    ring_[ringNext_] = s;
+    ringNext_ = (ringNext_ + 1 == PRE_SAMPLES) ? 0 : ringNext_ + 1;
+    if (ringN_ < PRE_SAMPLES) ringN_++;
+    return false;
+  }
+
+  if (n_ < MAX_SAMPLES) {
+    buf_[n_++] = s;
+  } else {
+    truncated_ = true;
+    waitRelease_ = true;
+  }
+  below_ = (s.g < cfg_.releaseG) ? below_ + 1 : 0;
+  if (below_ >= RELEASE_COUNT || truncated_) {
+    capturing_ = false;
+    ringN_ = 0;
+    return true;
+  }
+  return false;
+}
+
+// ---------------- WimEstimator ----------------
+
+namespace {
+
+// Time (s) where x first rises through `level`, interpolated
+float crossUp(const float* t, const float* x, size_t n, float level) {
+  for (size_t i = 0; i < n; i++) {
+    if (x[i] < level) continue;
+    if (i == 0) return t[0];
+    float f = (level - x[i - 1]) / (x[i] - x[i - 1]);
+    return t[i - 1] + f * (t[i] - t[i - 1]);
+  }
+  return t[n - 1];
+}
+
+// Time (s) where x last falls through `level`, interpolated
+float crossDown(const float* t, const float* x, size_t n, float level) {
+  for (size_t i = n; i-- > 0;) {
+    if (x[i] < level) continue;
+    if (i + 1 == n) return t[i];
+    float f = (x[i] - level) / (x[i] - x[i + 1]);
+    return t[i] + f * (t[i + 1] - t[i]);
+  }
+  return t[0];
+}
+
+// Standard errors that must fit in the tolerance for a trusted result.
+// The plateau mean's error is up to ~2.7 standard errors once ringing
+// dominates (test/test_wim), noise alone keeps it well under 2.
+const float SEM_SIGMAS = 3.0f;
+
+float sq(float v) { return v * v; }
+
+// Trapezoid model of the crossing, 0..1: ramps of tr seconds centred
+// on the half-level crossings
+float shapeAt(float t, float up50, float down50, float tr) {
+  float a = t - (up50 - 0.5f * tr);
+  float b = (down50 + 0.5f * tr) - t;
+  float edge = (a < b) ? a : b;
+  if (edge <= 0.0f) return 0.0f;
+  if (tr <= 0.0f || edge >= tr) return 1.0f;
+  return edge / tr;
+}
+
+}  // namespace
+
+WimResult WimEstimator::estimate(const WimSample* s, size_t n, float zeroG, bool truncated) {
+  WimResult r = {};
+  r.samples = (uint16_t)n;
+  r.truncated = truncated;
+  if (n > WimCapture::MAX_SAMPLES || n < 3) return r;
+
+  float* t = t_;
+  float* x = x_;
+  float peak = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    t[i] = (s[i].tUs - s[0].tUs) * 1e-6f;
+    x[i] = s[i].g - zeroG;
+    if (x[i] > peak) peak = x[i];
+  }
+  if (peak <= 0.0f) return r;
+
+  // Level from the upper part of the trace (peak alone is ringing-biased)
+  float level = 0.0f;
+  size_t nl = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (x[i] >= 0.8f * peak) {
+      level += x[i];
+      nl++;
+    }
+  }
+  level /= nl;
+
+  float up50 = crossUp(t, x, n, 0.5f * level);
+  float down50 = crossDown(t, x, n, 0.5f * level);
+  float dt = down50 - up50;  // = Lp / v for any item length
+  if (dt <= 0.0f) return r;
+
+  float rise = (crossUp(t, x, n, 0.9f * level) - crossUp(t, x, n, 0.1f * level)) / 0.8f;
+  float fall = (crossDown(t, x, n, 0.1f * level) - crossDown(t, x, n, 0.9f * level)) / 0.8f;
+  float tr = 0.5f * (rise + fall);  // Ramp time = item length / v
+  if (tr < 0.0f) tr = 0.0f;
+  if (tr > dt) tr = dt;
+
+  float v = (cfg_.platformMm > 0.0f) ? cfg_.platformMm / dt : cfg_.beltSpeedMmS;
+  r.speedMmS = v;
+
+  // Item fully on the platform: [up50 + tr/2, down50 - tr/2]
+  size_t first = n, last = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (t[i] < up50 + 0.5f * tr || t[i] > down50 - 0.5f * tr) continue;
+    if (first == n) first = i;
+    last = i;
+  }
+
+  // Plateau: least-variance window covering most of that span, so the
+  // ringing right after the item steps on is left out
+  size_t pStart = 0, pLen = 0;
+  if (first < n) {
+    size_t span = last - first + 1;
+    size_t m = (span * 6 + 9) / 10;
+    if (m < cfg_.minPlateau) m = (span < cfg_.minPlateau) ? span : cfg_.minPlateau;
+    float bestVar = 0.0f;
+    for (size_t a = first; a + m <= last + 1; a++) {
+      float mean = 0.0f;
+      for (size_t i = a; i < a + m; i++) mean += x[i];
+      mean /= m;
+      float var = 0.0f;
+      for (size_t i = a; i < a + m; i++) var += sq(x[i] - mean);
+      if (pLen == 0 || var < bestVar) {
+        bestVar = var;
+        pStart = a;
+        pLen = m;
+      }
+    }
+  }
+  if (pLen) {
+    float mean = 0.0f;
+    for (size_t i = pStart; i < pStart + pLen; i++) mean += x[i];
+    mean /= pLen;
+    float var = 0.0f;
+    for (size_t i = pStart; i < pStart + pLen; i++) var += sq(x[i] - mean);
+    r.plateauG = mean;
+    r.noiseG = (pLen > 1) ? sqrtf(var / (pLen - 1)) : 0.0f;
+    r.plateauN = (uint16_t)pLen;
+  }
+
+  // Least squares onto the trapezoid shape: W = sum(x*s) / sum(s*s)
+  float sxs = 0.0f, sss = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    float shape = shapeAt(t[i], up50, down50, tr);
+    sxs += x[i] * shape;
+    sss += shape * shape;
+  }
+  if (sss <= 0.0f) return r;
+  r.fitG = sxs / sss;
+
+  // Dynamic error grows with speed; speedComp is per m/s
+  float comp = 1.0f + cfg_.speedComp * v * 0.001f;
+  bool usePlateau = cfg_.minPlateau > 0 && r.plateauN >= cfg_.minPlateau;
+  r.weightG = (usePlateau ? r.plateauG : r.fitG) / comp;
+  r.ok = true;
+
+  // Standard error of the value used: plateau spread over its length,
+  // else the fit residual over the loaded samples
+  float sem;
+  if (usePlateau && r.plateauN > 1) {
+    sem = r.noiseG / sqrtf((float)r.plateauN);
+  } else {
+    float res = 0.0f;
+    size_t on = 0;
+    for (size_t i = 0; i < n; i++) {
+      float shape = shapeAt(t[i], up50, down50, tr);
+      if (shape <= 0.0f) continue;
+      res += sq(x[i] - r.fitG * shape);
+      on++;
+    }
+    sem = (on > 1) ? sqrtf(res / (on - 1) / on) : fabsf(r.fitG);
+  }
+  sem /= comp;
+
+  // Confidence: each term is 1 when ideal and falls towards 0. The error
+  // term is 0.5 when SEM_SIGMAS standard errors reach the tolerance, so a
+  // crossing sent as verified (conf >= 0.5) is within it
+  float tol = cfg_.tolG + cfg_.tolRel * fabsf(r.weightG);
+  if (tol <= 0.0f) tol = 1.0f;
+  float cLen = (cfg_.minPlateau > 0) ? (float)r.plateauN / cfg_.minPlateau : 1.0f;
+  if (cLen > 1.0f) cLen = 1.0f;
+  float cErr = 1.0f / (1.0f + sq(SEM_SIGMAS * sem / tol));
+  float cSpeed = 1.0f;
+  if (cfg_.beltSpeedMmS > 0.0f && cfg_.platformMm > 0.0f) {
+    // Item slipping or belt off speed: 10 % mismatch halves the confidence
+    cSpeed = 1.0f / (1.0f + sq((v - cfg_.beltSpeedMmS) / (0.1f * cfg_.beltSpeedMmS)));
+  }
+  r.confidence = truncated ? 0.0f : cLen * cErr * cSpeed;
+  return r;
+}
@@ -0,0 +1,114 @@
+/************************************************************
+ * WeighInMotion - Static weight from a moving load-cell pass
+ *
+ * The item crosses a load-cell platform of length Lp on the
+ * belt. Its signal is a trapezoid: ramp up while it moves on,
+ * plateau while it is fully on, ramp down while it moves off,
+ * plus the platform's ringing and HX711 noise.
+ *
+ * WimCapture keeps a few samples before the trigger and the
+ * whole crossing (fixed buffer) and tracks the empty-platform
+ * zero between items (the samples just before the trigger may
+ * already be on a slow item's ramp, so they are not the
+ * baseline). WimEstimator then works on the captured trace:
+ *   - Half-level crossing times: up at t0 + Tr/2, down at
+ *     t0 + Lp/v + Tr/2, so their distance gives the measured
+ *     belt speed v = Lp / dt whatever the item length.
+ *   - Plateau: the flattest window (least variance) of the
+ *     length the speed allows, (dt - Tr) seconds, inside the
+ *     part of the trace above half level.
+ *   - Fit: least squares of the trace onto the trapezoid model
+ *     (ramps from the 10-90 % rise/fall times).
+ *   - Speed compensation: w / (1 + speedComp * v[m/s]).
+ * The result is the plateau mean when the plateau is long
+ * enough, else the fit, with a 0..1 confidence from plateau
+ * length, the standard error of the result against the gram
+ * tolerance (tolG + tolRel * weight) and measured vs
+ * configured speed. Confidence >= 0.5 means the result is
+ * expected within the tolerance.
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct WimSample {
+  uint32_t tUs;
+  float g;
+};
+
+struct WimConfig {
+  float triggerG;       // Crossing starts above this
+  float releaseG;       // ... and ends below this
+  float platformMm;     // Load-cell platform length along the belt
+  float beltSpeedMmS;   // Configured belt speed (0 = unknown)
+  float speedComp;      // Fractional gain per m/s (dynamic error)
+  float tolG;           // Tolerance for a trusted result, grams
+  float tolRel;         // ... plus this fraction of the weight
+  uint16_t minPlateau;  // Samples needed to trust the plateau mean
+};
+
+struct WimResult {
+  bool ok;              // False: trace too short / no crossing
+  bool truncated;       // Capture buffer filled before the item left
+  float weightG;        // Compensated estimate
+  float confidence;     // 0..1
+  float plateauG;       // Plateau mean (uncompensated)
+  float fitG;           // Model fit (uncompensated)
+  float noiseG;         // Plateau standard deviation
+  float speedMmS;       // Measured from the half-level crossings
+  uint16_t plateauN;
+  uint16_t samples;
+};
+
+class WimCapture {
+public:
+  static const size_t MAX_SAMPLES = 400;  // 5 s at 80 SPS
+  static const size_t PRE_SAMPLES = 4;    // Baseline before the trigger
+  static const uint8_t RELEASE_COUNT = 4; // Samples below releaseG to end (longer than a ringing dip)
+  static const uint8_t ZERO_SHIFT = 5;    // Zero tracking EMA, 1/32 per idle sample
+
+  void setConfig(const WimConfig& cfg) { cfg_ = cfg; }
+
+  // True when a crossing has just been completed (see trace()).
+  bool add(const WimSample& s);
+  void reset();
+
+  bool capturing() const { return capturing_; }
+  bool truncated() const { return truncated_; }
+  size_t size() const { return n_; }
+  size_t preSamples() const { return pre_; }
+  float zero() const { return zero_; }  // Empty-platform reading at the trigger
+  const WimSample* trace() const { return buf_; }
+
+private:
+  WimConfig cfg_ = {};
+  WimSample buf_[MAX_SAMPLES];
+  size_t n_ = 0;
+  size_t pre_ = 0;            // Leading samples in buf_ taken before the trigger
+  WimSample ring_[PRE_SAMPLES];
+  size_t ringN_ = 0;
+  size_t ringNext_ = 0;
+  bool capturing_ = false;
+  bool truncated_ = false;
+  bool waitRelease_ = false;  // Truncated: wait for the item to leave
+  uint8_t below_ = 0;
+  float zero_ = 0.0f;         // Scale is tared, so start from 0
+};
+
+class WimEstimator {
+public:
+  void setConfig(const WimConfig& cfg) { cfg_ = cfg; }
+
+  // zeroG: empty-platform reading, subtracted from every sample.
+  WimResult estimate(const WimSample* s, size_t n, float zeroG, bool truncated);
+
+private:
+  WimConfig cfg_ = {};
+  // Scratch (seconds since the first sample, grams above baseline),
+  // kept here rather than on a small task stack
+  float t_[WimCapture::MAX_SAMPLES];
+  float x_[WimCapture::MAX_SAMPLES];
+};
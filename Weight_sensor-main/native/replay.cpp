@@ -0,0 +1,174 @@
+/************************************************************
+ * Replay trace cua Module 1 tren may tinh (env:native)
+ *
+ *   pio run -e native
+ *   .pio/build/native/program capture.bin [--wim] [--trigger G] [--remove G]
+ *
+ * capture.bin: du lieu Serial tho cua lenh 'r' ... 'd' (xem
+ * tools/dump_to_csv.py). Mau HX711 (TR_HX711_RAW) doi ra gram
+ * bang offset tru bi (TR_MARK 't') va he so hieu chuan (TR_MARK
+ * 'k', ghi khi bat 'r'), roi dua vao dung logic cua firmware:
+ * ScaleMachine (can tinh) hoac WimCapture/WimEstimator (--wim).
+ *
+ * Chi replay phan logic: main.cpp dung task FreeRTOS, HX711,
+ * LCD, servo nen khong build native duoc. Chu ky day hang duoc
+ * gia lap bang thoi gian (THOI_GIAN_*). In CSV moi ket qua can
+ * (verified = 0: se gui LM_UNVERIFIED) kem khoi luong ban ghi da
+ * gui (TR_NOW_TX) de so sanh.
+ ************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "NowLink.h"
+#include "ScaleMachine.h"
+#include "TraceCapture.h"
+#include "TraceLog.h"
+#include "WeighInMotion.h"
+
+// Gia tri mac dinh trong src/main.cpp
+#define CALIBRATION_FACTOR 401.94f
+#define MEASURE_TIME       3000
+#define REMOVE_CONFIRM_MS  500
+#define HIEN_THI_KET_QUA_MS 2000
+#define THOI_GIAN_DAY_HANG (2600 + 500 + 3000)  // Day ra + cho + thu ve (ms)
+
+static WimCapture wimCapture;
+static WimEstimator wimEstimator;
+
+static void cachDung() {
+  fprintf(stderr, "usage: program capture.bin [--wim] [--trigger G] [--remove G]\n");
+}
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  bool canDong = false;
+  float trigger = 30.0f;
+  float remove = 10.0f;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--wim") == 0) {
+      canDong = true;
+    } else if (strcmp(argv[i], "--trigger") == 0 && i + 1 < argc) {
+      trigger = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "--remove") == 0 && i + 1 < argc) {
+      remove = (float)atof(argv[++i]);
+    } else if (!path) {
+      path = argv[i];
+    } else {
+      cachDung();
+      return 2;
+    }
+  }
+  if (!path) {
+    cachDung();
+    return 2;
+  }
+
+  std::vector<TraceRecord> recs;
+  if (!loadTraceCapture(path, recs)) {
+    fprintf(stderr, "%s: khong co khoi TRACE day du\n", path);
+    return 1;
+  }
+
+  // Khoi luong da gui trong lan chay that (ca LM_UNVERIFIED), theo thu tu
+  std::vector<float> daGui;
+  for (const TraceRecord& r : recs) {
+    if (r.kind == TR_NOW_TX && (r.arg == LM_WEIGHT || r.arg == LM_UNVERIFIED)) {
+      daGui.push_back(r.value / 1000.0f);
+    }
+  }
+
+  ScaleMachine mayCan;
+  ScaleConfig sc = {trigger, remove, MEASURE_TIME, REMOVE_CONFIRM_MS, HIEN_THI_KET_QUA_MS};
+  mayCan.setConfig(sc);
+  mayCan.onConnected();
+
+  WimConfig wc = {};
+  wc.triggerG = trigger;
+  wc.releaseG = remove;
+  wc.platformMm = 300;
+  wc.beltSpeedMmS = 300;
+  wc.tolG = 1.0f;
+  wc.tolRel = 0.005f;
+  wc.minPlateau = 4;
+  wimCapture.setConfig(wc);
+  wimEstimator.setConfig(wc);
+
+  int32_t offset = 0;
+  float heSo = CALIBRATION_FACTOR;
+  bool coOffset = false;
+  bool dangDay = false;
+  uint32_t dayXongMs = 0;
+  size_t soKetQua = 0;
+  size_t soTinCay = 0;
+  size_t soMau = 0;
+  TraceCursor cur(recs.data(), recs.size());
+
+  printf("t_ms,weight_g,confidence,verified,recorded_g\n");
+  TraceRecord r;
+  while (!cur.done()) {
+    uint32_t tUs = cur.nextTimeUs();  // Tinh tu ban ghi dau
+    cur.nextDue(tUs, r);
+    uint32_t nowMs = tUs / 1000;
+    if (r.kind == TR_MARK && r.arg == 't') {
+      offset = r.value;
+      coOffset = true;
+      mayCan.onTared();
+      wimCapture.reset();
+      continue;
+    }
+    if (r.kind == TR_MARK && r.arg == 'k') {
+      if (r.value > 0) heSo = r.value / 1000.0f;
+      continue;
+    }
+    if (r.kind != TR_HX711_RAW || !coOffset) continue;
+
+    float gram = (float)(r.value - offset) / heSo;
+    soMau++;
+    if (dangDay && (int32_t)(nowMs - dayXongMs) >= 0) {
+      mayCan.onPushDone();
+      dangDay = false;
+    }
+
+    bool coKetQua = false;
+    float g = 0, conf = 1;
+    bool tinCay = false;
+    if (canDong) {
+      WimSample s = {r.tUs, gram};
+      if (wimCapture.add(s)) {
+        WimResult w = wimEstimator.estimate(wimCapture.trace(), wimCapture.size(),
+                                            wimCapture.zero(), wimCapture.truncated());
+        coKetQua = true;
+        g = w.weightG;
+        conf = w.confidence;
+        tinCay = w.ok && w.confidence >= 0.5f;  // WIM_MIN_CONF
+      }
+    } else {
+      ScaleOutput out = mayCan.onSample(gram, nowMs);
+      if (out.sendWeight) {
+        coKetQua = true;
+        g = out.weightG;
+        tinCay = true;
+      }
+      if (out.startPush) {
+        dangDay = true;
+        dayXongMs = nowMs + THOI_GIAN_DAY_HANG;
+      }
+    }
+    if (!coKetQua) continue;
+
+    printf("%u,%.3f,%.2f,%d,", (unsigned)nowMs, g, conf, tinCay ? 1 : 0);
+    if (soKetQua < daGui.size()) {
+      printf("%.3f\n", daGui[soKetQua]);
+    } else {
+      printf("\n");
+    }
+    soKetQua++;
+    if (tinCay) soTinCay++;
+  }
+  fprintf(stderr, "%u mau, %u ket qua (%u tin cay), %u da gui khi ghi\n", (unsigned)soMau,
+          (unsigned)soKetQua, (unsigned)soTinCay, (unsigned)daGui.size());
+  if (!coOffset) fprintf(stderr, "Khong co TR_MARK 't': bat ghi bang 'r' truoc khi dump\n");
+  return 0;
+}
@@ -3,9 +3,20 @@
 #include <LiquidCrystal_I2C.h> 
 #include "HX711.h"          
 #include <WiFi.h>           
-#include "ESP32_NOW_Serial.h"
-#include "MacAddress.h"
 #include <ESP32Servo.h>     
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include "TraceLog.h"
+#include "DumpFrame.h"
+#include "ParamRegistry.h"
+#include "NowLink.h"
+#include "StageLatency.h"
+#include "ScaleMachine.h"
+#include "WeighInMotion.h"
 
 // --- Cau hinh LCD ---
 LiquidCrystal_I2C lcd(0x27, 16, 2); 
@@ -22,66 +33,264 @@ HX711 scale;
 #define SERVO_PIN 17
 Servo myServo;
 
-// --- Cau hinh ESP-NOW Serial ---
+// --- Cau hinh ESP-NOW (datagram LinkMsg, xem NowLink.h) ---
 // Module 1 MAC: 20:E7:C8:67:39:70 (ESP32)
 // Module 2 MAC: 10:20:BA:49:CD:D0 (ESP32-S3)
 #define ESPNOW_WIFI_CHANNEL 1
-const MacAddress peer_mac({0x10, 0x20, 0xBA, 0x49, 0xCD, 0xD0}); // MAC cua Module 2
-ESP_NOW_Serial_Class NowSerial(peer_mac, ESPNOW_WIFI_CHANNEL, WIFI_IF_STA);
+const uint8_t peer_mac[6] = {0x10, 0x20, 0xBA, 0x49, 0xCD, 0xD0}; // MAC cua Module 2
+EspNowLink nowLink;
+uint16_t txSeq = 0;         // So thu tu goi LM_WEIGHT
+LinkLatency linkLatency;    // Tre tu send() -> handler ben Module 2 (tu ACK)
+
+// --- Do tre tung cong doan (lenh "lat"), doi chieu voi Module 2 theo seq ---
+enum LatStage { LAT_SETTLE_SEND, LAT_SEND_HANDLER, LAT_STAGES };
+const char* const LAT_NAMES[LAT_STAGES] = { "settle->send", "send->handler" };
+StageLatency stageLatency;
+uint32_t lastSettleAgeUs = 0;  // settle -> send cua goi LM_WEIGHT cuoi
 
 // --- He so hieu chuan ---
 float calibration_factor = 401.94;
 
-// --- Bien cho May trang thai (State Machine) ---
-enum ScaleState {
-  CONNECTING,
-  WAITING,
-  MEASURING,
-  DISPLAYING
-};
-ScaleState currentState = CONNECTING;
-bool hasDisplayed = false;
-bool isConnected = false;
+// --- May trang thai (ScaleMachine, chi task do can goi vao) ---
+ScaleMachine mayCan;
+volatile ScaleState trangThai = CONNECTING;  // Ban sao cho loop() / lenh Serial
+volatile bool dangDayHang = false;
 
-unsigned long measurementStartTime = 0;     
-float finalWeight = 0.0;          
+// --- Cau hinh (chinh duoc qua Serial, xem dangKyThamSo()) ---
+float TRIGGER_WEIGHT = 30.0; // Nguong de bat dau can (gram)
+float REMOVE_WEIGHT = 10.0;  // Nguong de reset (gram)
+float DEAD_ZONE = 2.0;       
+int MEASURE_TIME = 3000;     // Thoi gian do (3 giay)
+int REMOVE_CONFIRM_MS = 500; // Can phai ve 0 lien tuc trong khoang nay
+#define HIEN_THI_KET_QUA_MS 2000  // Hien ket qua roi moi gui va day hang
 
-// --- Cau hinh ---
-const float TRIGGER_WEIGHT = 30.0; // Nguong de bat dau can (gram)
-const float REMOVE_WEIGHT = 10.0;  // Nguong de reset (gram)
-const float DEAD_ZONE = 2.0;       
-const int MEASURE_TIME = 3000;     // Thoi gian do (3 giay)
+// --- Can dong (weigh-in-motion, WIM_MODE = 1) ---
+// Can dat duoi mot doan bang tai: hang chay qua, khong dung, khong day.
+// Can HX711 o 80 SPS (chan RATE len 3V3); o 10 SPS mot vat 300 mm/s chi
+// co vai mau tren ban can. TRIGGER_WEIGHT / REMOVE_WEIGHT la nguong bat
+// dau / ket thuc ghi vet. Ket qua co do tin cay < WIM_MIN_CONF van gui, la
+// LM_UNVERIFIED (ton mot seq nhu LM_WEIGHT): Module 2 dua vat vao thung loai
+// ma khong lech thu tu khoi luong cua cac vat sau.
+int WIM_MODE = 0;              // 0 = can tinh + day hang, 1 = can dong
+float WIM_PLATFORM_MM = 300;   // Chieu dai ban can theo chieu bang tai
+float WIM_BELT_MM_S = 300;     // Toc do bang tai cau hinh (0 = khong biet)
+float WIM_SPEED_COMP = 0;      // Sai so dong: ti le moi m/s (0.02 = +2% o 1 m/s)
+float WIM_TOL_G = 1.0;         // Dung sai (gram) cho ket qua tin cay
+float WIM_TOL_PCT = 0.5;       // ... cong them % khoi luong
+int WIM_MIN_PLATEAU = 4;       // So mau phang toi thieu de dung trung binh
+float WIM_MIN_CONF = 0.5;      // Do tin cay toi thieu de gui LM_WEIGHT
+WimCapture wimCapture;         // Chi task do can dung
+WimEstimator wimEstimator;
+// Vet va ket qua lan qua cuoi cho lenh "wim" (task do can ghi, loop() doc)
+WimSample wimVet[WimCapture::MAX_SAMPLES];
+size_t wimVetN = 0;
+float wimVetZero = 0;
+WimResult wimCuoi = {};
+bool wimCuoiTinCay = false;
+volatile bool wimDangIn = false;  // loop() dang in, task do can khong ghi de
+portMUX_TYPE wimMux = portMUX_INITIALIZER_UNLOCKED;
 
 // --- Cau hinh Servo MG996R 360° voi thanh rang ---
 // Servo 360°: 90 = dung, <90 = quay day ra (nho=nhanh), >90 = quay thu ve (lon=nhanh)
-const int THOI_GIAN_DAY_RA = 2600;   // Thoi gian day ra (ms)
-const int THOI_GIAN_THU_VE = 3000;   // Thoi gian thu ve (ms)
-const int THOI_GIAN_CHO_DAY = 500;   // Thoi gian cho sau khi day (ms)
-const int TOC_DO_DAY_RA = 30;        // Toc do day ra (0-89, nho = nhanh)
-const int TOC_DO_THU_VE = 150;       // Toc do thu ve (91-180, lon = nhanh)
-const int GIA_TRI_DUNG = 90;         // Gia tri dung servo
-
-// Hàm gửi kết quả cân nặng qua ESP-NOW Serial
-void sendWeightResult(float weight_kg) {
-  // Chuyển sang gram
-  float weight_g = weight_kg * 1000.0;
-  
-  // Tạo chuỗi format: "Khoi_luong:XXX.XXXg\n"
-  char buffer[50];
-  snprintf(buffer, sizeof(buffer), "Khoi_luong:%.3fg\n", weight_g);
-  
-  // Gửi qua ESP-NOW Serial
-  if (NowSerial.availableForWrite()) {
-    NowSerial.print(buffer);
-    Serial.printf(">>> Gửi: %s", buffer);
-    isConnected = true;
+int THOI_GIAN_DAY_RA = 2600;   // Thoi gian day ra (ms)
+int THOI_GIAN_THU_VE = 3000;   // Thoi gian thu ve (ms)
+int THOI_GIAN_CHO_DAY = 500;   // Thoi gian cho sau khi day (ms)
+int TOC_DO_DAY_RA = 30;        // Toc do day ra (0-89, nho = nhanh)
+int TOC_DO_THU_VE = 150;       // Toc do thu ve (91-180, lon = nhanh)
+int GIA_TRI_DUNG = 90;         // Gia tri dung servo
+
+// --- Tham so runtime ---
+// Lenh Serial (moi dong mot lenh): list | get TEN | set TEN GIA_TRI |
+// defaults | save | load. Gia tri moi chi ap dung o trang thai WAITING,
+// ca bo bi bo neu vi pham REMOVE_WEIGHT < TRIGGER_WEIGHT.
+// loop() chi ghi gia tri cho (giu thamSoMutex) roi bao EV_THAM_SO; task do
+// can (noi doc cac tham so) tu ap dung o diem an toan cua no.
+ParamRegistry params;
+CommandLine serialCmd;
+Preferences prefs;
+
+// --- Ghi trace (record/replay) ---
+// Lenh Serial: r = bat/tat ghi, d = dump nhi phan, c = xoa, t = tru bi
+// Dump gui tung frame (DumpFrame.h): dong log cua cac task chen vao giua
+// cac frame, cong cu giai ma bo qua.
+#define TRACE_CAPACITY_PSRAM 200000  // so ban ghi (10 byte/ban ghi)
+#define TRACE_CAPACITY_HEAP  4096    // khi khong co PSRAM (~40 KB)
+#define TRACE_DUMP_CHUNK     1024    // byte du lieu toi da moi vong loop() khi dump
+#define SERIAL_TX_BUFFER     1024    // Du cho ca frame dump
+TraceLog traceLog;
+portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;  // Nhieu task cung ghi
+bool traceDumping = false;
+size_t traceDumpOffset = 0;
+
+// --- Kien truc FreeRTOS ---
+//   Task       Uu tien Core  Viec
+//   laymau       5      1    HX711 -> hangMau (khong bao gio cho LCD/servo)
+//   docan        4      1    hangMau -> ScaleMachine -> hangGui / EV_DAY,
+//                            ap dung tham so khi dang cho
+//   link         3      0    hangGui -> LM_WEIGHT / LM_UNVERIFIED, ACK, HELLO
+//   dayhang      2      1    EV_DAY -> chu ky servo -> EV_DAY_XONG
+//   giaodien     1      1    hopThuUI -> LCD (chi task nay ghi LCD)
+//   loop()       1      1    Lenh Serial, dump trace
+// Lenh "tasks": stack con trong thap nhat va thoi gian CPU tung task
+// (tu luc thuc day den luc cho tiep, tru delay() cua servo o dayhang).
+struct MauCan {
+  uint32_t tUs;
+  int32_t raw;
+  float gram;
+};
+
+struct KetQuaCan {
+  float gram;
+  uint32_t settleUs;  // micros() khi co ket qua on dinh
+  bool tinCay;        // false: uoc luong WIM khong du tin cay -> LM_UNVERIFIED
+};
+
+// Ban chup trang thai cho giao dien (hop thu 1 phan tu, ghi de)
+struct TrangThaiUI {
+  ScaleState state;
+  bool pushing;
+  float liveG;
+  float finalG;
+  uint32_t ketQuaMs;     // millis() khi vao DISPLAYING
+  const char* thongBao;  // Thong bao tam thoi (hang 1), nullptr = khong co
+  uint32_t thongBaoDenMs;
+  bool wim;              // Che do can dong
+  uint32_t wimSoLan;     // So lan qua da uoc luong
+  float wimG;            // Ket qua lan qua cuoi
+  float wimConf;
+  bool wimTinCay;        // Gui LM_WEIGHT (false: LM_UNVERIFIED, Module 2 loai)
+};
+
+#define HANG_MAU_LEN 32  // ~3 s mau HX711 o 10 SPS
+#define SO_MAU_TRU_BI 10 // Mau lay trung binh khi tru bi
+#define HANG_GUI_LEN 4
+
+#define EV_KET_NOI    (1 << 0)  // Module 2 da nhan HELLO
+#define EV_DAY        (1 << 1)  // Bat dau chu ky day hang
+#define EV_DAY_XONG   (1 << 2)  // Chu ky day hang xong
+#define EV_TRU_BI     (1 << 3)  // Yeu cau tru bi (task lay mau thuc hien)
+#define EV_DA_TRU_BI  (1 << 4)  // Tru bi xong
+#define EV_THAM_SO    (1 << 5)  // Co tham so dang cho ap dung
+
+StaticQueue_t hangMauCtrl, hangGuiCtrl, hopThuUICtrl;
+uint8_t hangMauBuf[HANG_MAU_LEN * sizeof(MauCan)];
+uint8_t hangGuiBuf[HANG_GUI_LEN * sizeof(KetQuaCan)];
+uint8_t hopThuUIBuf[sizeof(TrangThaiUI)];
+QueueHandle_t hangMau, hangGui, hopThuUI;
+StaticEventGroup_t suKienCtrl;
+EventGroupHandle_t suKien;
+StaticSemaphore_t thamSoMutexCtrl;
+SemaphoreHandle_t thamSoMutex;  // Gia tri cho trong params (loop() ghi, docan ap dung)
+volatile uint32_t mauBiMat = 0;  // hangMau day (task do can bi tre)
+
+// Thoi gian CPU: do tu luc task thuc day den luc task cho tiep, tru thoi
+// gian cho trong vong do (choUs). Task uu tien cao hon chen vao van tinh.
+enum TaskId { TK_LAY_MAU, TK_DO_CAN, TK_LINK, TK_DAY_HANG, TK_GIAO_DIEN, TK_SO_TASK };
+struct ThongKeTask {
+  const char* ten;
+  uint32_t stackBytes;
+  UBaseType_t uuTien;
+  BaseType_t core;
+  TaskHandle_t handle;
+  volatile uint32_t busyUs;
+  volatile uint32_t lanChay;
+  volatile uint32_t maxUs;
+};
+ThongKeTask thongKe[TK_SO_TASK] = {
+  {"laymau",   3072, 5, 1, nullptr, 0, 0, 0},
+  {"docan",    4096, 4, 1, nullptr, 0, 0, 0},
+  {"link",     4096, 3, 0, nullptr, 0, 0, 0},
+  {"dayhang",  3072, 2, 1, nullptr, 0, 0, 0},
+  {"giaodien", 3072, 1, 1, nullptr, 0, 0, 0},
+};
+uint32_t thongKeTuUs = 0;  // Moc tinh % CPU (lenh "tasks clear")
+uint32_t dayHangChoUs = 0; // delay() cua servo trong chu ky day hang dang chay
+
+void ghiThoiGianTask(TaskId id, uint32_t batDauUs, uint32_t choUs = 0) {
+  uint32_t us = micros() - batDauUs - choUs;
+  ThongKeTask& tk = thongKe[id];
+  tk.busyUs = tk.busyUs + us;
+  tk.lanChay = tk.lanChay + 1;
+  if (us > tk.maxUs) tk.maxUs = us;
+}
+
+void ghiTrace(uint32_t tUs, uint8_t kind, uint8_t arg, int32_t value) {
+  portENTER_CRITICAL(&traceMux);
+  traceLog.record(tUs, kind, arg, value);
+  portEXIT_CRITICAL(&traceMux);
+}
+
+// Cho DOUT san sang bang vTaskDelay(1) de khong chiem CPU cua task khac.
+// Thoi gian cho cong vao choUs (khong tinh la CPU cua task lay mau).
+bool choHX711(uint32_t& choUs) {
+  uint32_t t0 = micros();
+  bool sanSang = scale.wait_ready_timeout(200, 1);
+  choUs += micros() - t0;
+  return sanSang;
+}
+
+// Doc mot mau HX711 (raw -> gram), ghi raw vao trace.
+bool docMau(MauCan& m, uint32_t& choUs) {
+  if (!choHX711(choUs)) return false;
+  m.raw = scale.read();
+  m.tUs = micros();
+  ghiTrace(m.tUs, TR_HX711_RAW, 1, m.raw);
+  m.gram = (float)(m.raw - scale.get_offset()) / scale.get_scale();
+  return true;
+}
+
+// Hàm gửi kết quả cân nặng qua ESP-NOW (một LinkMsg LM_WEIGHT). Kết quả
+// không đủ tin cậy vẫn gửi (LM_UNVERIFIED, cùng dãy seq) để Module 2 biết
+// sản phẩm đó tồn tại và loại nó, thay vì gán khối lượng của sản phẩm sau.
+void sendWeightResult(float weight_kg, uint32_t settleUs, bool tinCay) {
+  LinkMsg m = {};
+  m.magic = LINK_MAGIC;
+  m.type = tinCay ? LM_WEIGHT : LM_UNVERIFIED;
+  m.seq = ++txSeq;
+  m.value = (int32_t)(weight_kg * 1000000.0f);  // mg
+  m.txUs = micros();
+  m.aux = m.txUs - settleUs;  // Module 2 dung de tinh cong doan settle->send
+  lastSettleAgeUs = m.aux;
+  stageLatency.add(LAT_SETTLE_SEND, m.aux);
+
+  if (nowLink.send(m)) {
+    ghiTrace(m.txUs, TR_NOW_TX, m.type, m.value);
+    ghiTrace(m.txUs, TR_NOW_SEQ, m.type, m.seq);
+    Serial.printf(">>> Gửi: seq %u, %.3f g%s\n", (unsigned)m.seq, m.value / 1000.0f,
+                  tinCay ? "" : " (chua xac minh)");
   } else {
-    Serial.println(">>> ESP-NOW Serial không sẵn sàng!");
+    Serial.println(">>> ESP-NOW không sẵn sàng!");
+  }
+}
+
+// Xu ly goi nhan ve (ACK tu Module 2): tinh do tre
+void xuLyLink() {
+  LinkRx rx;
+  while (nowLink.receive(rx)) {
+    ghiTrace(micros(), TR_NOW_RX, rx.msg.type, rx.msg.value);
+    if (rx.msg.type != LM_ACK) continue;
+    // Dung thoi diem callback (rxUs) de task cham khong lam sai so do
+    uint32_t rtt = rx.rxUs - rx.msg.txUs;
+    uint32_t hold = (uint32_t)rx.msg.value;
+    uint32_t lat = (rtt + hold) / 2;
+    linkLatency.add(lat);
+    stageLatency.add(LAT_SEND_HANDLER, lat);
+    if (rx.msg.seq == txSeq) {
+      Serial.printf("LAT seq=%u settle->send=%lu send->handler=%lu us\n", (unsigned)rx.msg.seq,
+                    (unsigned long)lastSettleAgeUs, (unsigned long)lat);
+    }
   }
 }
 
 // === HAM DIEU KHIEN SERVO MG996R 360° ===
 
+// delay() cua chu ky servo: task nhuong CPU, khong tinh vao cpu% cua dayhang
+void choServo(uint32_t ms) {
+  uint32_t t0 = micros();
+  delay(ms);
+  dayHangChoUs += micros() - t0;
+}
+
 // Dung servo
 void dungServo() {
   myServo.write(GIA_TRI_DUNG);
@@ -91,7 +300,7 @@ void dungServo() {
 void dayThanhRangRa() {
   Serial.println("-> Day thanh rang ra...");
   myServo.write(TOC_DO_DAY_RA);
-  delay(THOI_GIAN_DAY_RA);
+  choServo(THOI_GIAN_DAY_RA);
   dungServo();
   Serial.println("   Da day xong!");
 }
@@ -100,7 +309,7 @@ void dayThanhRangRa() {
 void thuThanhRangVe() {
   Serial.println("<- Thu thanh rang ve...");
   myServo.write(TOC_DO_THU_VE);
-  delay(THOI_GIAN_THU_VE);
+  choServo(THOI_GIAN_THU_VE);
   dungServo();
   Serial.println("   Da thu xong!");
 }
@@ -108,11 +317,562 @@ void thuThanhRangVe() {
 // Chu ky tu dong: Day ra -> Cho -> Thu ve
 void chuKyDayThu() {
   dayThanhRangRa();
-  delay(THOI_GIAN_CHO_DAY);
+  choServo(THOI_GIAN_CHO_DAY);
   thuThanhRangVe();
 }
 
+// === CAC TASK ===
+
+// Tru bi: trung binh SO_MAU_TRU_BI mau doc nhu docMau. Khong dung
+// scale.tare(): read_average() cho DOUT bang delay(0), chiem core 1 ca
+// giay (10 mau o 10 SPS) o uu tien cua task lay mau.
+bool truBi(uint32_t& choUs) {
+  long tong = 0;
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < SO_MAU_TRU_BI; i++) {
+    if (!choHX711(choUs)) continue;
+    tong += scale.read();
+    n++;
+  }
+  if (n == 0) return false;
+  scale.set_offset(tong / n);
+  return true;
+}
+
+// Lay mau lien tuc, uu tien cao nhat. Tru bi cung lam o day vi
+// chi task nay duoc dung HX711. CPU chi tinh phan doc (scale.read()),
+// khong tinh luc cho DOUT.
+void taskLayMau(void*) {
+  for (;;) {
+    uint32_t t0 = micros();
+    uint32_t choUs = 0;
+    MauCan m;
+    bool coMau = docMau(m, choUs);
+    if (xEventGroupGetBits(suKien) & EV_TRU_BI) {
+      if (!truBi(choUs)) Serial.println("Tru bi loi: HX711 khong san sang");
+      ghiTrace(micros(), TR_MARK, 't', (int32_t)scale.get_offset());
+      xEventGroupClearBits(suKien, EV_TRU_BI);
+      xEventGroupSetBits(suKien, EV_DA_TRU_BI);
+      coMau = false;  // Mau vua doc thuoc offset cu
+    }
+    if (coMau && xQueueSend(hangMau, &m, 0) != pdTRUE) {
+      mauBiMat = mauBiMat + 1;
+    }
+    ghiThoiGianTask(TK_LAY_MAU, t0, choUs);
+  }
+}
+
+// Can dong: ghi vet lan qua, uoc luong, gui ket qua (kem co tin cay).
+// Tra ve true khi dang ghi vet (vat dang tren ban can).
+bool xuLyCanDong(const MauCan& m, TrangThaiUI& ui) {
+  WimConfig cfg;
+  cfg.triggerG = TRIGGER_WEIGHT;
+  cfg.releaseG = REMOVE_WEIGHT;
+  cfg.platformMm = WIM_PLATFORM_MM;
+  cfg.beltSpeedMmS = WIM_BELT_MM_S;
+  cfg.speedComp = WIM_SPEED_COMP;
+  cfg.tolG = WIM_TOL_G;
+  cfg.tolRel = WIM_TOL_PCT / 100.0f;
+  cfg.minPlateau = (uint16_t)WIM_MIN_PLATEAU;
+  wimCapture.setConfig(cfg);
+  wimEstimator.setConfig(cfg);
+
+  WimSample s = {m.tUs, m.gram};
+  if (!wimCapture.add(s)) return wimCapture.capturing();
+
+  WimResult r = wimEstimator.estimate(wimCapture.trace(), wimCapture.size(),
+                                      wimCapture.zero(), wimCapture.truncated());
+  bool tinCay = r.ok && r.confidence >= WIM_MIN_CONF;
+  Serial.printf("WIM w=%.2f g conf=%.2f plateau=%.2f/%u fit=%.2f noise=%.2f v=%.0f mm/s n=%u%s\n",
+                r.weightG, r.confidence, r.plateauG, (unsigned)r.plateauN, r.fitG, r.noiseG,
+                r.speedMmS, (unsigned)r.samples, r.truncated ? " (cat)" : "");
+  // Moi lan qua deu gui (giu seq khop voi san pham); khong tin cay -> Module 2 loai
+  KetQuaCan kq = {r.weightG, (uint32_t)micros(), tinCay};
+  xQueueSend(hangGui, &kq, 0);
+  if (!tinCay) Serial.println("WIM: do tin cay thap, gui LM_UNVERIFIED");
+  ghiTrace(micros(), TR_MARK, 'w', (int32_t)(r.weightG * 1000.0f));
+
+  portENTER_CRITICAL(&wimMux);
+  if (!wimDangIn) {
+    wimVetN = wimCapture.size();
+    memcpy(wimVet, wimCapture.trace(), wimVetN * sizeof(WimSample));
+    wimVetZero = wimCapture.zero();
+    wimCuoi = r;
+    wimCuoiTinCay = tinCay;
+  }
+  portEXIT_CRITICAL(&wimMux);
+
+  ui.wimSoLan++;
+  ui.wimG = r.weightG;
+  ui.wimConf = r.confidence;
+  ui.wimTinCay = tinCay;
+  return false;
+}
+
+void apDungThamSo();  // Canh dangKyThamSo()
+
+// Dua mau vao ScaleMachine (hoac can dong) va phat lenh cho task link / day hang
+void taskDoCan(void*) {
+  TrangThaiUI ui = {};
+  ui.state = CONNECTING;
+  bool canDong = false;  // Dang o che do can dong
+  bool dangQua = false;  // Can dong: vat dang tren ban can
+  for (;;) {
+    MauCan m;
+    bool coMau = xQueueReceive(hangMau, &m, pdMS_TO_TICKS(50)) == pdTRUE;
+    uint32_t t0 = micros();
+    uint32_t now = millis();
+
+    EventBits_t bits = xEventGroupClearBits(suKien, EV_DAY_XONG | EV_DA_TRU_BI);
+    if ((bits & EV_KET_NOI) && mayCan.state() == CONNECTING) {
+      mayCan.onConnected();
+      ui.thongBao = "Da ket noi!";
+      ui.thongBaoDenMs = now + 2000;
+    }
+    if (bits & EV_DAY_XONG) {
+      mayCan.onPushDone();
+      Serial.println("Hoan thanh chu ky!");
+    }
+    if (bits & EV_DA_TRU_BI) {
+      mayCan.onTared();
+      wimCapture.reset();
+      Serial.println("DA TRU BI!");
+      ui.thongBao = "DA TRU BI!";
+      ui.thongBaoDenMs = now + 1000;
+    }
+
+    // Tham so moi: ap dung o day, giua hai mau, chi khi khong dang can / day
+    // hang. Khong cho mutex: neu loop() dang ghi thi de vong sau.
+    bool dangCho = mayCan.state() == WAITING || mayCan.state() == CONNECTING;
+    if ((bits & EV_THAM_SO) && dangCho && !dangQua && !mayCan.pushing() &&
+        xSemaphoreTake(thamSoMutex, 0) == pdTRUE) {
+      xEventGroupClearBits(suKien, EV_THAM_SO);
+      apDungThamSo();
+      xSemaphoreGive(thamSoMutex);
+    }
+
+    // Doi che do chi khi dang cho (tham so moi chi ap dung o WAITING)
+    if ((WIM_MODE != 0) != canDong && mayCan.state() == WAITING) {
+      canDong = WIM_MODE != 0;
+      wimCapture.reset();
+      dangQua = false;
+      Serial.println(canDong ? "Che do can dong (WIM)" : "Che do can tinh");
+    }
+
+    if (coMau && canDong) {
+      // ScaleMachine dung yen o WAITING (khong do tinh, khong day)
+      dangQua = xuLyCanDong(m, ui);
+      ui.liveG = m.gram;
+    } else if (coMau) {
+      ScaleConfig cfg;
+      cfg.triggerG = TRIGGER_WEIGHT;
+      cfg.removeG = REMOVE_WEIGHT;
+      cfg.measureMs = (uint32_t)MEASURE_TIME;
+      cfg.removeConfirmMs = (uint32_t)REMOVE_CONFIRM_MS;
+      cfg.displayMs = HIEN_THI_KET_QUA_MS;
+      mayCan.setConfig(cfg);
+
+      ScaleOutput out = mayCan.onSample(m.gram, now);
+      if (out.stateChanged) {
+        switch (mayCan.state()) {
+          case MEASURING:
+            Serial.printf("Phat hien vat nang > %.0fg. Bat dau do...\n", TRIGGER_WEIGHT);
+            break;
+          case DISPLAYING:
+            Serial.println("Het gio. Lay ket qua.");
+            ui.ketQuaMs = now;
+            break;
+          case WAITING:
+            Serial.println("Can da ve 0, san sang can tiep!");
+            break;
+          default:
+            break;
+        }
+      }
+      if (out.sendWeight) {
+        KetQuaCan kq = {out.weightG, (uint32_t)micros(), true};
+        xQueueSend(hangGui, &kq, 0);
+      }
+      if (out.startPush) {
+        xEventGroupSetBits(suKien, EV_DAY);
+      }
+    }
+
+    // Can dong: bao MEASURING khi vat dang qua (lenh "t" khong tru bi giua chung)
+    trangThai = (canDong && dangQua) ? MEASURING : mayCan.state();
+    dangDayHang = mayCan.pushing();
+    ui.state = trangThai;
+    ui.pushing = mayCan.pushing();
+    ui.wim = canDong;
+    if (!canDong) ui.liveG = mayCan.liveG();
+    ui.finalG = mayCan.finalG();
+    xQueueOverwrite(hopThuUI, &ui);
+    ghiThoiGianTask(TK_DO_CAN, t0);
+  }
+}
+
+// Gui ket qua, nhan ACK; khi chua ket noi thi gui HELLO moi 200 ms
+void taskLink(void*) {
+  TickType_t lanHelloCuoi = 0;
+  for (;;) {
+    KetQuaCan kq;
+    bool coKetQua = xQueueReceive(hangGui, &kq, pdMS_TO_TICKS(20)) == pdTRUE;
+    uint32_t t0 = micros();
+
+    if (coKetQua) {
+      sendWeightResult(kq.gram / 1000.0f, kq.settleUs, kq.tinCay);
+    }
+    xuLyLink();
+
+    if (!(xEventGroupGetBits(suKien) & EV_KET_NOI) &&
+        xTaskGetTickCount() - lanHelloCuoi >= pdMS_TO_TICKS(200)) {
+      // Gửi gói HELLO để kiểm tra kết nối; Module 2 nhận được
+      // khi callback gửi báo thành công (ACK tầng MAC)
+      lanHelloCuoi = xTaskGetTickCount();
+      LinkMsg hello = {};
+      hello.magic = LINK_MAGIC;
+      hello.type = LM_HELLO;
+      hello.txUs = micros();
+      if (nowLink.send(hello)) {
+        ghiTrace(hello.txUs, TR_NOW_TX, LM_HELLO, 0);
+      }
+      if (nowLink.delivered() > 0) {
+        Serial.println("Da ket noi voi ESP kia!");
+        xEventGroupSetBits(suKien, EV_KET_NOI);
+      }
+    }
+    ghiThoiGianTask(TK_LINK, t0);
+  }
+}
+
+// Chu ky servo 6 s chay rieng, khong lam tre lay mau
+void taskDayHang(void*) {
+  for (;;) {
+    xEventGroupWaitBits(suKien, EV_DAY, pdTRUE, pdFALSE, portMAX_DELAY);
+    uint32_t t0 = micros();
+    dayHangChoUs = 0;
+    Serial.println("Bat dau chu ky day hang...");
+    chuKyDayThu();
+    xEventGroupSetBits(suKien, EV_DAY_XONG);
+    ghiThoiGianTask(TK_DAY_HANG, t0, dayHangChoUs);
+  }
+}
+
+// Khoi luong hien thi (kg): am hoac trong "vung chet" thi coi la 0
+float khoiLuongHienThi(float gram) {
+  if (gram <= 0 || (gram > -DEAD_ZONE && gram < DEAD_ZONE)) return 0.0f;
+  return gram / 1000.0f;
+}
+
+// Ve LCD tu ban chup trang thai; chi ghi hang nao thay doi
+void taskGiaoDien(void*) {
+  char hangCu[2][17] = {"", ""};
+  TickType_t lanCuoi = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&lanCuoi, pdMS_TO_TICKS(200));
+    uint32_t t0 = micros();
+    uint32_t now = millis();
+
+    TrangThaiUI ui;
+    if (xQueuePeek(hopThuUI, &ui, 0) != pdTRUE) {
+      ui = {};
+      ui.state = CONNECTING;
+    }
+
+    char hang[2][17];
+    if (ui.thongBao && (int32_t)(now - ui.thongBaoDenMs) < 0) {
+      snprintf(hang[0], sizeof(hang[0]), "%-16s", ui.thongBao);
+      snprintf(hang[1], sizeof(hang[1]), "%-16s", "");
+    } else {
+      switch (ui.state) {
+        case CONNECTING:
+          snprintf(hang[0], sizeof(hang[0]), "%-16s", "Ket noi voi bang");
+          snprintf(hang[1], sizeof(hang[1]), "%-16s", "chuyen...");
+          break;
+        case WAITING:
+          if (ui.wim && ui.wimSoLan) {
+            // Ket qua lan qua cuoi: do tin cay va Module 2 phan loai hay loai bo
+            char dong[17];
+            snprintf(dong, sizeof(dong), "WIM c=%.2f %s", ui.wimConf, ui.wimTinCay ? "gui" : "loai");
+            snprintf(hang[0], sizeof(hang[0]), "%-16s", dong);
+            snprintf(hang[1], sizeof(hang[1]), "%.3f kg%-8s", khoiLuongHienThi(ui.wimG), "");
+            break;
+          }
+          snprintf(hang[0], sizeof(hang[0]), "%-16s", ui.wim ? "WIM san sang" : "San sang can!");
+          snprintf(hang[1], sizeof(hang[1]), "%.3f kg%-8s", khoiLuongHienThi(ui.liveG), "");
+          break;
+        case MEASURING:
+          snprintf(hang[0], sizeof(hang[0]), "%-16s", ui.wim ? "WIM dang qua..." : "Dang do...");
+          snprintf(hang[1], sizeof(hang[1]), "%.3f kg%-8s", khoiLuongHienThi(ui.liveG), "");
+          break;
+        case DISPLAYING:
+          if (ui.pushing && now - ui.ketQuaMs < HIEN_THI_KET_QUA_MS) {
+            // Hiển thị kết quả 2 giây
+            snprintf(hang[0], sizeof(hang[0]), "%-16s", "Khoi luong:");
+          } else if (ui.pushing) {
+            snprintf(hang[0], sizeof(hang[0]), "%-16s", "Day xuong BC...");
+          } else {
+            snprintf(hang[0], sizeof(hang[0]), "%-16s", "Cho lay hang...");
+          }
+          snprintf(hang[1], sizeof(hang[1]), "%.3f kg%-8s", ui.finalG / 1000.0f, "");
+          break;
+      }
+    }
+
+    for (int r = 0; r < 2; r++) {
+      if (strcmp(hang[r], hangCu[r]) == 0) continue;
+      lcd.setCursor(0, r);
+      lcd.print(hang[r]);
+      strcpy(hangCu[r], hang[r]);
+    }
+    ghiThoiGianTask(TK_GIAO_DIEN, t0);
+  }
+}
+
+void taoTask() {
+  hangMau = xQueueCreateStatic(HANG_MAU_LEN, sizeof(MauCan), hangMauBuf, &hangMauCtrl);
+  hangGui = xQueueCreateStatic(HANG_GUI_LEN, sizeof(KetQuaCan), hangGuiBuf, &hangGuiCtrl);
+  hopThuUI = xQueueCreateStatic(1, sizeof(TrangThaiUI), hopThuUIBuf, &hopThuUICtrl);
+  suKien = xEventGroupCreateStatic(&suKienCtrl);
+  thamSoMutex = xSemaphoreCreateMutexStatic(&thamSoMutexCtrl);
+
+  const TaskFunction_t ham[TK_SO_TASK] = {
+    taskLayMau, taskDoCan, taskLink, taskDayHang, taskGiaoDien
+  };
+  for (int i = 0; i < TK_SO_TASK; i++) {
+    ThongKeTask& tk = thongKe[i];
+    if (xTaskCreatePinnedToCore(ham[i], tk.ten, tk.stackBytes, nullptr, tk.uuTien,
+                                &tk.handle, tk.core) != pdPASS) {
+      Serial.printf("LOI: khong tao duoc task %s\n", tk.ten);
+    }
+  }
+  thongKeTuUs = micros();
+}
+
+// Lenh "tasks": stack con trong thap nhat (byte) va % CPU tu lan xoa cuoi
+void inThongKeTask() {
+  uint32_t tongUs = micros() - thongKeTuUs;
+  Serial.println("task      prio core stack_min  cpu%   runs   max_us");
+  for (int i = 0; i < TK_SO_TASK; i++) {
+    const ThongKeTask& tk = thongKe[i];
+    unsigned hwm = tk.handle ? (unsigned)uxTaskGetStackHighWaterMark(tk.handle) : 0;
+    Serial.printf("%-9s %4u %4d %9u %5.1f %6lu %8lu\n", tk.ten, (unsigned)tk.uuTien,
+                  (int)tk.core, hwm, tongUs ? 100.0f * tk.busyUs / tongUs : 0.0f,
+                  (unsigned long)tk.lanChay, (unsigned long)tk.maxUs);
+  }
+  Serial.printf("loop stack_min %u, mau bi mat %lu\n",
+                (unsigned)uxTaskGetStackHighWaterMark(nullptr), (unsigned long)mauBiMat);
+}
+
+// === THAM SO RUNTIME ===
+
+// Rang buoc giua cac tham so, kiem tra tren ca bo gia tri dang cho
+static const char* kiemTraThamSo(const ParamRegistry& reg) {
+  if (!(reg.stagedFloat("REMOVE_WEIGHT") < reg.stagedFloat("TRIGGER_WEIGHT"))) {
+    return "REMOVE_WEIGHT phai nho hon TRIGGER_WEIGHT";
+  }
+  return nullptr;
+}
+
+void dangKyThamSo() {
+  params.setCheck(kiemTraThamSo);
+  params.addFloat("TRIGGER_WEIGHT", &TRIGGER_WEIGHT, 1, 5000);
+  params.addFloat("REMOVE_WEIGHT", &REMOVE_WEIGHT, 0, 5000);
+  params.addFloat("DEAD_ZONE", &DEAD_ZONE, 0, 100);
+  params.addInt("MEASURE_TIME", &MEASURE_TIME, 100, 20000);
+  params.addInt("REMOVE_CONFIRM_MS", &REMOVE_CONFIRM_MS, 0, 5000);
+  params.addFloat("calibration_factor", &calibration_factor, 1, 100000);
+  params.addInt("THOI_GIAN_DAY_RA", &THOI_GIAN_DAY_RA, 0, 10000);
+  params.addInt("THOI_GIAN_THU_VE", &THOI_GIAN_THU_VE, 0, 10000);
+  params.addInt("THOI_GIAN_CHO_DAY", &THOI_GIAN_CHO_DAY, 0, 10000);
+  params.addInt("TOC_DO_DAY_RA", &TOC_DO_DAY_RA, 0, 89);
+  params.addInt("TOC_DO_THU_VE", &TOC_DO_THU_VE, 91, 180);
+  params.addInt("GIA_TRI_DUNG", &GIA_TRI_DUNG, 80, 100);
+  params.addInt("WIM_MODE", &WIM_MODE, 0, 1);
+  params.addFloat("WIM_PLATFORM_MM", &WIM_PLATFORM_MM, 10, 2000);
+  params.addFloat("WIM_BELT_MM_S", &WIM_BELT_MM_S, 0, 5000);
+  params.addFloat("WIM_SPEED_COMP", &WIM_SPEED_COMP, -0.5f, 0.5f);
+  params.addFloat("WIM_TOL_G", &WIM_TOL_G, 0, 100);
+  params.addFloat("WIM_TOL_PCT", &WIM_TOL_PCT, 0, 10);
+  params.addInt("WIM_MIN_PLATEAU", &WIM_MIN_PLATEAU, 0, 200);
+  params.addFloat("WIM_MIN_CONF", &WIM_MIN_CONF, 0, 1);
+  if (params.addFailed()) {
+    Serial.printf("LOI: bang tham so day (%u), %s tro di khong dang ky duoc\n",
+                  (unsigned)ParamRegistry::MAX_PARAMS, params.addFailed());
+  }
+}
+
+// Ap dung gia tri dang cho (chi task do can goi, giu thamSoMutex)
+void apDungThamSo() {
+  if (!params.hasPending()) return;
+  size_t n = params.applyPending();
+  if (params.rejectReason()) {
+    Serial.printf("Tham so bi tu choi, khong ap dung: %s\n", params.rejectReason());
+    return;
+  }
+  scale.set_scale(calibration_factor);
+  dungServo();
+  Serial.printf("Da ap dung %u tham so.\n", (unsigned)n);
+}
+
+// Doc tham so da luu trong NVS (luc khoi dong hoac lenh "load")
+void docThamSo() {
+  char key[16];
+  size_t n = 0;
+  prefs.begin("can", true);
+  for (size_t i = 0; i < params.count(); i++) {
+    const ParamInfo& pi = params.info(i);
+    ParamRegistry::nvsKey(pi.name, key, sizeof(key));
+    if (!prefs.isKey(key)) continue;
+    ParamValue v;
+    if (pi.type == PT_FLOAT) {
+      v.f = prefs.getFloat(key, pi.def.f);
+    } else {
+      v.i = prefs.getInt(key, pi.def.i);
+    }
+    if (params.setValue(i, v) == PS_OK) n++;
+  }
+  prefs.end();
+  Serial.printf("Doc %u tham so tu NVS.\n", (unsigned)n);
+}
+
+void luuThamSo() {
+  char key[16];
+  prefs.begin("can", false);
+  for (size_t i = 0; i < params.count(); i++) {
+    const ParamInfo& pi = params.info(i);
+    ParamRegistry::nvsKey(pi.name, key, sizeof(key));
+    ParamValue v = params.value(i);
+    if (pi.type == PT_FLOAT) {
+      prefs.putFloat(key, v.f);
+    } else {
+      prefs.putInt(key, v.i);
+    }
+  }
+  prefs.end();
+  Serial.println("OK saved");
+}
+
+// Lenh "wim": vet lan qua cuoi (t ms tu mau dau, gram) va ket qua uoc luong.
+// Dong "S tUs gram" / "E" de ghi lai va chay lai uoc luong tren may tinh
+// (test/test_wim). Gram in du 9 chu so de chay lai ra dung ket qua cua may
+// (lam tron 0.01 g lam w lech toi 0.04 g, conf toi 0.06).
+void inVetCanDong() {
+  portENTER_CRITICAL(&wimMux);
+  wimDangIn = true;
+  portEXIT_CRITICAL(&wimMux);
+
+  if (wimVetN == 0) {
+    Serial.println("Chua co lan qua nao.");
+  } else {
+    Serial.printf("WIM TRACE %u zero=%.9g\n", (unsigned)wimVetN, wimVetZero);
+    for (size_t i = 0; i < wimVetN; i++) {
+      Serial.printf("S %lu %.9g  ; t=%.1f ms\n", (unsigned long)wimVet[i].tUs, wimVet[i].g,
+                    (wimVet[i].tUs - wimVet[0].tUs) / 1000.0f);
+    }
+    Serial.println("E");
+    const WimResult& r = wimCuoi;
+    Serial.printf("w=%.2f g conf=%.2f plateau=%.2f/%u fit=%.2f noise=%.2f v=%.0f mm/s %s\n",
+                  r.weightG, r.confidence, r.plateauG, (unsigned)r.plateauN, r.fitG, r.noiseG,
+                  r.speedMmS, wimCuoiTinCay ? "gui LM_WEIGHT" : "gui LM_UNVERIFIED");
+  }
+
+  portENTER_CRITICAL(&wimMux);
+  wimDangIn = false;
+  portEXIT_CRITICAL(&wimMux);
+}
+
+static void inDong(const char* line) {
+  Serial.println(line);
+}
+
+// Doc het cac ky tu Serial dang cho, xu ly tung dong lenh
+void xuLyLenhSerial() {
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (traceDumping) continue;  // Khong nhan lenh khi dang dump
+    if (!serialCmd.feed(c)) continue;
+
+    // Lenh tham so giu mutex: task do can khong ap dung giua chung
+    const char* cmd = serialCmd.argv(0);
+    bool luu = strcasecmp(cmd, "save") == 0;
+    bool doc = strcasecmp(cmd, "load") == 0;
+    xSemaphoreTake(thamSoMutex, portMAX_DELAY);
+    bool xong = handleParamCommand(params, serialCmd, inDong);
+    if (luu) luuThamSo();
+    if (doc) docThamSo();
+    xSemaphoreGive(thamSoMutex);
+    if (xong || luu || doc) continue;
+
+    if (strcasecmp(cmd, "lat") == 0) {
+      if (strcasecmp(serialCmd.argv(1), "clear") == 0) {
+        stageLatency.clear();
+        Serial.println("OK");
+      }
+      for (size_t i = 0; i < stageLatency.stages(); i++) {
+        StageLatency::Summary sm;
+        if (!stageLatency.summary(i, sm)) continue;
+        Serial.printf("%-14s n=%lu p50=%lu p95=%lu p99=%lu max=%lu us\n", stageLatency.name(i),
+                      (unsigned long)sm.count, (unsigned long)sm.p50, (unsigned long)sm.p95,
+                      (unsigned long)sm.p99, (unsigned long)sm.max);
+      }
+    } else if (strcasecmp(cmd, "link") == 0) {
+      Serial.printf("sent=%u delivered=%u failed=%u acks=%u rx_foreign=%u\n", (unsigned)txSeq,
+                    (unsigned)nowLink.delivered(), (unsigned)nowLink.failed(),
+                    (unsigned)linkLatency.count, (unsigned)nowLink.rxForeign());
+      if (linkLatency.count) {
+        Serial.printf("latency us: last=%u min=%u avg=%u max=%u\n",
+                      (unsigned)linkLatency.lastUs, (unsigned)linkLatency.minUs,
+                      (unsigned)linkLatency.avgUs(), (unsigned)linkLatency.maxUs);
+      }
+    } else if (strcasecmp(cmd, "tasks") == 0) {
+      if (strcasecmp(serialCmd.argv(1), "clear") == 0) {
+        for (int i = 0; i < TK_SO_TASK; i++) {
+          thongKe[i].busyUs = 0;
+          thongKe[i].lanChay = 0;
+          thongKe[i].maxUs = 0;
+        }
+        thongKeTuUs = micros();
+        Serial.println("OK");
+      } else {
+        inThongKeTask();
+      }
+    } else if (strcasecmp(cmd, "wim") == 0) {
+      inVetCanDong();
+    } else if (strcasecmp(cmd, "r") == 0) {
+      traceLog.setEnabled(!traceLog.enabled());
+      // Ghi offset tru bi va he so hieu chuan de replay doi raw -> gram dung
+      ghiTrace(micros(), TR_MARK, 't', (int32_t)scale.get_offset());
+      ghiTrace(micros(), TR_MARK, 'k', (int32_t)(scale.get_scale() * 1000.0f));
+      Serial.printf("Trace: %s (%u/%u)\n", traceLog.enabled() ? "BAT" : "TAT",
+                    (unsigned)traceLog.size(), (unsigned)traceLog.capacity());
+    } else if (strcasecmp(cmd, "d") == 0) {
+      // Dung ghi trong luc dump de du lieu nhat quan
+      traceLog.setEnabled(false);
+      traceDumping = true;
+      traceDumpOffset = 0;
+      Serial.printf("TRACE BEGIN %u %u %u\n", (unsigned)traceLog.size(),
+                    (unsigned)sizeof(TraceRecord), (unsigned)traceLog.overwritten());
+    } else if (strcasecmp(cmd, "c") == 0) {
+      traceLog.clear();
+      Serial.println("Da xoa trace.");
+    } else if (strcasecmp(cmd, "t") == 0) {
+      // --- LENH TRU BI KHAN CAP --- (task lay mau thuc hien)
+      if (trangThai == WAITING || (trangThai == DISPLAYING && !dangDayHang)) {
+        xEventGroupSetBits(suKien, EV_TRU_BI);
+      }
+    } else if (strcasecmp(cmd, "help") == 0) {
+      Serial.println("list | get TEN | set TEN GIA_TRI | defaults | save | load");
+      Serial.println("t (tru bi) | r (trace bat/tat) | d (dump trace) | c (xoa trace) | link | lat [clear]");
+      Serial.println("tasks [clear] (stack, CPU tung task) | wim (vet lan qua cuoi)");
+    } else {
+      Serial.println("ERR lenh khong hop le (help)");
+    }
+  }
+}
+
 void setup() {
+  Serial.setTxBufferSize(SERIAL_TX_BUFFER);  // Truoc begin()
   Serial.begin(115200);
   Serial.print("Dia chi MAC cua ESP (sender): ");
   Serial.println(WiFi.macAddress());
@@ -120,216 +880,99 @@ void setup() {
   // Khởi động HX711
   Serial.println("Khoi dong HX711...");
   scale.begin(LOADCELL_DOUT_PIN, LOADCELL_SCK_PIN);
+  dangKyThamSo();
+  stageLatency.begin(LAT_NAMES, LAT_STAGES);
+  docThamSo();
+  params.applyPending();  // Luc khoi dong luon an toan
+  if (params.rejectReason()) {
+    Serial.printf("Tham so NVS bi tu choi (%s), dung mac dinh.\n", params.rejectReason());
+  }
   scale.set_scale(calibration_factor);
-  scale.tare(); 
+  uint32_t choUs = 0;
+  if (!truBi(choUs)) Serial.println("Tru bi loi: HX711 khong san sang");
   Serial.println("HX711 san sang.");
 
+  // Bo dem trace: PSRAM neu co, neu khong dung heap
+  size_t traceCap = TRACE_CAPACITY_PSRAM;
+  TraceRecord* traceBuf = nullptr;
+  if (psramFound()) {
+    traceBuf = (TraceRecord*)ps_malloc(traceCap * sizeof(TraceRecord));
+  }
+  if (!traceBuf) {
+    traceCap = TRACE_CAPACITY_HEAP;
+    traceBuf = (TraceRecord*)malloc(traceCap * sizeof(TraceRecord));
+  }
+  traceLog.attach(traceBuf, traceBuf ? traceCap : 0);
+  Serial.printf("Trace: %u ban ghi\n", (unsigned)traceLog.capacity());
+
   // Khởi động LCD
   Serial.println("Khoi dong LCD I2C...");
   Wire.begin(I2C_SDA, I2C_SCL); 
   lcd.init();
   lcd.backlight();
-  
+
   // Khởi động Servo MG996R 360° với thanh răng
   ESP32PWM::allocateTimer(0);
   myServo.setPeriodHertz(50);
   myServo.attach(SERVO_PIN, 500, 2400);
   dungServo();  // Dung servo ngay khi khoi dong
-  
-  // Khởi động ESP-NOW Serial
-  Serial.println("Khoi dong ESP-NOW Serial...");
+
+  // Khởi động ESP-NOW
+  Serial.println("Khoi dong ESP-NOW...");
   WiFi.mode(WIFI_STA);
   WiFi.setChannel(ESPNOW_WIFI_CHANNEL);
-  
+
   while (!WiFi.STA.started()) {
     delay(100);
   }
-  
+
   Serial.print("MAC Address: ");
   Serial.println(WiFi.macAddress());
   Serial.print("Channel: ");
   Serial.println(ESPNOW_WIFI_CHANNEL);
   Serial.print("Peer MAC (Module 2): ");
   Serial.println("10:20:BA:49:CD:D0");
-  
-  // Khởi động ESP-NOW Serial
+
+  // Khởi động ESP-NOW (callback -> queue, khong dung byte stream)
   Serial.println("ESP-NOW communication starting...");
-  NowSerial.begin(115200);
-  Serial.println("ESP-NOW Serial san sang.");
-  
+  if (nowLink.begin(peer_mac, ESPNOW_WIFI_CHANNEL)) {
+    Serial.println("ESP-NOW san sang.");
+  } else {
+    Serial.println("LOI: khoi dong ESP-NOW that bai!");
+  }
+
   lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("Ket noi voi bang");
-  lcd.setCursor(0, 1);
-  lcd.print("chuyen...");
+  taoTask();
   Serial.println("Dang o trang thai CONNECTING.");
 }
 
+// loop() chi con lenh Serial va dump trace; may trang thai chay trong cac task
 void loop() {
-  // --- LENH TRU BI KHAN CAP ---
-  if (Serial.available()) {
-    char temp = Serial.read();
-    if ((temp == 't' || temp == 'T') && (currentState == WAITING || currentState == DISPLAYING)) {
-      scale.tare(); 
-      Serial.println("DA TRU BI!");
-      
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("DA TRU BI!");
-      delay(1000); 
-      currentState = WAITING; 
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("San sang can!");
-    }
-  }
+  // --- LENH SERIAL (tru bi, tham so, trace) ---
+  xuLyLenhSerial();
 
-  // --- CO MAY TRANG THAI CHINH ---
-  switch (currentState) {
-    case CONNECTING: {
-      // Gửi gói dữ liệu để kiểm tra kết nối
-      if (NowSerial.availableForWrite()) {
-        NowSerial.print("Khoi_luong:0.000g\n");
-        isConnected = true;
-      }
-      
-      if (isConnected) {
-        // Đã kết nối thành công
-        Serial.println("Da ket noi voi ESP kia!");
-        
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("Da ket noi!");
-        delay(2000);
-        
-        // Chuyển sang trạng thái WAITING
-        currentState = WAITING;
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("San sang can!");
-      }
-      break;
-    }
-    
-    case WAITING: {
-      float currentWeight = scale.get_units(5);
-      
-      // === PHAN SUA DOI DE LOAI BO NHAY SO VA SO AM ===
-      float displayWeight_kg;
-
-      // Neu khoi luong am hoac nam trong "vung chet", thi coi la 0
-      if (currentWeight <= 0 || (currentWeight > -DEAD_ZONE && currentWeight < DEAD_ZONE)) {
-        displayWeight_kg = 0.0;
-      } else {
-        displayWeight_kg = currentWeight / 1000.0;
-      }
-      
-      // Hien thi "live" da duoc xu ly
-      lcd.setCursor(0, 1);
-      lcd.print(displayWeight_kg, 3);
-      lcd.print(" kg "); // Co khoang trang de xoa so cu
-      // === KET THUC SUA DOI ===
-
-      // Kiem tra de bat dau can (van dung gia tri GOC)
-      if (currentWeight > TRIGGER_WEIGHT) {
-        Serial.println("Phat hien vat nang > 30g. Bat dau do...");
-        currentState = MEASURING;
-        measurementStartTime = millis(); 
-        
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("Dang do...");
-      }
-      break;
-    }
-    
-    case MEASURING: {
-      unsigned long elapsed = millis() - measurementStartTime;
-      
-      // Đọc cân nặng hiện tại
-      float currentWeight = scale.get_units(3);  // Lấy 3 mẫu để đọc nhanh
-      float currentWeight_kg = currentWeight / 1000.0;
-
-      // Hiển thị "Dang do" và cân nặng
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("Dang do...");
-      
-      // Hiển thị cân nặng ở hàng 2
-      lcd.setCursor(0, 1);
-      if (currentWeight <= 0 || (currentWeight > -DEAD_ZONE && currentWeight < DEAD_ZONE)) {
-        lcd.print("0.000 kg");
-      } else {
-        lcd.print(currentWeight_kg, 3);
-        lcd.print(" kg");
-      }
+  // Tham so moi: task do can ap dung khi khong dang can / day hang
+  if (params.hasPending()) xEventGroupSetBits(suKien, EV_THAM_SO);
 
-      // Kiểm tra hết giờ
-      if (elapsed >= MEASURE_TIME) {
-        Serial.println("Het gio. Lay ket qua.");
-        finalWeight = scale.get_units(10);  // Lấy kết quả cuối với 10 mẫu
-        hasDisplayed = false;
-        currentState = DISPLAYING;
-      }
-      break;
+  // --- DUMP TRACE TUNG PHAN (khong chan loop qua lau) ---
+  // Moi frame mot lan write(), chi khi bo dem TX con du cho (khong chan)
+  if (traceDumping) {
+    uint8_t data[DUMP_FRAME_MAX_DATA];
+    uint8_t frame[DUMP_FRAME_MAX];
+    size_t daGui = 0;
+    while (daGui < TRACE_DUMP_CHUNK && Serial.availableForWrite() >= DUMP_FRAME_MAX) {
+      size_t n = traceLog.copyBytes(traceDumpOffset, data, sizeof(data));
+      if (n == 0) break;
+      Serial.write(frame, dumpFrameEncode((uint32_t)traceDumpOffset, data, n, frame));
+      traceDumpOffset += n;
+      daGui += n;
     }
-    
-    case DISPLAYING: {
-      // --- KHOI LOGIC CHI CHAY MOT LAN ---
-      if (!hasDisplayed) {
-        // Chuyen sang kg và hiển thị kết quả
-        float finalWeight_kg = finalWeight / 1000.0;
-        
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("Khoi luong:");
-        lcd.setCursor(0, 1);
-        lcd.print(finalWeight_kg, 3);
-        lcd.print(" kg");
-        
-        delay(2000); // Hiển thị kết quả 2 giây
-        
-        // Gửi dữ liệu qua ESP-NOW ngay sau khi có kết quả
-        sendWeightResult(finalWeight_kg);
-        
-        // Thông báo đẩy xuống băng chuyền
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("Day xuong");
-        lcd.setCursor(0, 1);
-        lcd.print("bang chuyen...");
-        
-        // Thuc hien chu ky: Day ra -> Cho -> Thu ve
-        Serial.println("Bat dau chu ky day hang...");
-        chuKyDayThu();
-        Serial.println("Hoan thanh chu ky!");
-        
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("Cho lay hang...");
-        
-        hasDisplayed = true;
-      }
-
-      // Kiểm tra cân đã về 0 chưa
-      float currentWeight = scale.get_units(5);
-      if (currentWeight < REMOVE_WEIGHT) {
-        // Chờ và kiểm tra lại để đảm bảo cân đã ổn định
-        delay(500);
-        currentWeight = scale.get_units(5);
-        
-        if (currentWeight < REMOVE_WEIGHT) {
-          Serial.println("Can da ve 0, san sang can tiep!");
-          
-          currentState = WAITING;
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print("San sang can!");
-        }
-      }
-      break;
+    if (traceDumpOffset >= traceLog.sizeBytes()) {
+      Serial.println();
+      Serial.println("TRACE END");
+      traceDumping = false;
     }
   }
 
-  delay(200);
-}
\ No newline at end of file
+  delay(20);
+}
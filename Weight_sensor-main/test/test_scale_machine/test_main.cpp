@@ -0,0 +1,193 @@
+// Host tests for ScaleMachine: trigger -> settle -> measure, the result
+// display before send and push, the push interlock, removal debounce
+// and tare.
+#include <unity.h>
+
+#include "ScaleMachine.h"
+
+#define STEP_MS 100  // HX711 at 10 SPS
+
+static ScaleMachine sm;
+static uint32_t nowMs;
+
+// What the steps since the last reset asked for
+struct Seen {
+  int sends;
+  int pushes;
+  float weightG;
+};
+static Seen seen;
+
+static void feed(float g, int samples) {
+  for (int i = 0; i < samples; i++) {
+    nowMs += STEP_MS;
+    ScaleOutput out = sm.onSample(g, nowMs);
+    if (out.sendWeight) {
+      seen.sends++;
+      seen.weightG = out.weightG;
+    }
+    if (out.startPush) seen.pushes++;
+  }
+}
+
+static ScaleConfig config() {
+  ScaleConfig c;
+  c.triggerG = 30.0f;
+  c.removeG = 10.0f;
+  c.measureMs = 3000;
+  c.removeConfirmMs = 500;
+  c.displayMs = 2000;
+  return c;
+}
+
+// Connected, empty, then an item put on: up to the step that shows
+// the result
+static void weighItem(float g) {
+  feed(0.0f, 10);
+  feed(g, 1);  // Mean of 5 above the trigger for any g > 150
+  TEST_ASSERT_EQUAL(MEASURING, sm.state());
+  for (int i = 0; i < 100 && sm.state() == MEASURING; i++) feed(g, 1);
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+}
+
+void setUp(void) {
+  sm = ScaleMachine();
+  sm.setConfig(config());
+  sm.onConnected();
+  nowMs = 0;
+  seen = Seen();
+}
+
+void tearDown(void) {}
+
+void test_connecting_ignores_load(void) {
+  ScaleMachine m;
+  m.setConfig(config());
+  for (int i = 0; i < 20; i++) m.onSample(500.0f, (uint32_t)i * STEP_MS);
+  TEST_ASSERT_EQUAL(CONNECTING, m.state());
+  m.onConnected();
+  TEST_ASSERT_EQUAL(WAITING, m.state());
+}
+
+void test_trigger_needs_mean_of_five(void) {
+  feed(0.0f, 10);
+  feed(100.0f, 1);  // Mean 20 g: a knock, not an item
+  feed(0.0f, 1);
+  TEST_ASSERT_EQUAL(WAITING, sm.state());
+  feed(100.0f, 2);  // Mean 40 g
+  TEST_ASSERT_EQUAL(MEASURING, sm.state());
+}
+
+void test_measure_uses_settled_samples(void) {
+  feed(0.0f, 10);
+  feed(150.0f, 3);
+  TEST_ASSERT_EQUAL(MEASURING, sm.state());
+  // Settling: the item still rocks, then rests at 200 g. The final
+  // value is the mean of the last 10 samples taken while measuring
+  feed(260.0f, 10);
+  feed(200.0f, 20);
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 200.0f, sm.finalG());
+  TEST_ASSERT_EQUAL_INT(0, seen.sends);
+}
+
+void test_short_measure_uses_only_its_samples(void) {
+  ScaleConfig c = config();
+  c.measureMs = 300;  // Three samples
+  sm.setConfig(c);
+  feed(0.0f, 10);
+  feed(100.0f, 2);   // Trigger; window still holds zeros
+  feed(120.0f, 3);
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 120.0f, sm.finalG());
+}
+
+void test_result_shown_before_send_and_push(void) {
+  weighItem(250.0f);
+  uint32_t shownMs = nowMs;
+  TEST_ASSERT_TRUE(sm.pushing());
+  while (nowMs - shownMs < 2000 - STEP_MS) {
+    feed(250.0f, 1);
+    TEST_ASSERT_EQUAL_INT(0, seen.sends);
+  }
+  feed(250.0f, 1);
+  TEST_ASSERT_EQUAL_INT(1, seen.sends);
+  TEST_ASSERT_EQUAL_INT(1, seen.pushes);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 250.0f, seen.weightG);
+  feed(250.0f, 30);  // Once per item
+  TEST_ASSERT_EQUAL_INT(1, seen.sends);
+}
+
+void test_no_trigger_while_pushing(void) {
+  weighItem(250.0f);
+  feed(250.0f, 20);
+  TEST_ASSERT_EQUAL_INT(1, seen.pushes);
+  // Item pushed off, next one put on before the pusher is back
+  feed(0.0f, 10);
+  feed(300.0f, 20);
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+  TEST_ASSERT_TRUE(sm.pushing());
+  TEST_ASSERT_EQUAL_INT(1, seen.sends);
+}
+
+void test_push_done_before_push_is_ignored(void) {
+  weighItem(250.0f);
+  sm.onPushDone();  // Stale EV_DAY_XONG
+  TEST_ASSERT_TRUE(sm.pushing());
+  feed(0.0f, 10);
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+}
+
+void test_removal_debounce(void) {
+  weighItem(250.0f);
+  feed(250.0f, 20);
+  sm.onPushDone();
+  // Empty for less than removeConfirmMs, then a bounce
+  feed(0.0f, 9);   // Mean of 5 below 10 g from the 5th sample on
+  feed(80.0f, 2);
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+  feed(0.0f, 9);
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+  feed(0.0f, 2);   // 500 ms below after the bounce
+  TEST_ASSERT_EQUAL(WAITING, sm.state());
+  TEST_ASSERT_EQUAL_INT(1, seen.sends);
+}
+
+void test_tare_clears_window(void) {
+  feed(25.0f, 10);  // Drifted, still under the trigger
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 25.0f, sm.liveG());
+  sm.onTared();
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, sm.liveG());
+  TEST_ASSERT_EQUAL(WAITING, sm.state());
+  // Samples on the old offset are not averaged with the new ones
+  feed(0.0f, 1);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, sm.liveG());
+}
+
+void test_tare_during_push_keeps_state(void) {
+  weighItem(250.0f);
+  sm.onTared();
+  TEST_ASSERT_EQUAL(DISPLAYING, sm.state());
+  TEST_ASSERT_TRUE(sm.pushing());
+
+  // After the push, a tare ends the item like an empty scale would
+  feed(250.0f, 20);
+  sm.onPushDone();
+  sm.onTared();
+  TEST_ASSERT_EQUAL(WAITING, sm.state());
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connecting_ignores_load);
+  RUN_TEST(test_trigger_needs_mean_of_five);
+  RUN_TEST(test_measure_uses_settled_samples);
+  RUN_TEST(test_short_measure_uses_only_its_samples);
+  RUN_TEST(test_result_shown_before_send_and_push);
+  RUN_TEST(test_no_trigger_while_pushing);
+  RUN_TEST(test_push_done_before_push_is_ignored);
+  RUN_TEST(test_removal_debounce);
+  RUN_TEST(test_tare_clears_window);
+  RUN_TEST(test_tare_during_push_keeps_state);
+  return UNITY_END();
+}
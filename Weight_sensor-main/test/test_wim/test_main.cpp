@@ -0,0 +1,371 @@
+// Host tests for WeighInMotion (pio test -e native -v shows the report):
+// synthetic crossings swept over belt speed (accuracy vs speed), a belt
+// speed mismatch, and replay of traces recorded with the "wim" command.
+//
+// Recorded traces: save the serial output of "wim" (WIM TRACE ... E and
+// the w= line after it) as test/wim_traces/<name>.txt and add a line
+// "REF <gram>" with the weight from the static scale. The test re-runs
+// the estimator on every trace found there (WIM_TRACE_DIR overrides the
+// directory) and reports the error against REF.
+#include <unity.h>
+
+#include <dirent.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "WeighInMotion.h"
+
+#define SPS 80            // HX711 at 80 SPS
+#define ITEMS 300         // Synthetic items per speed
+#define PLATFORM_MM 300.0f
+#define MIN_CONF 0.5f     // WIM_MIN_CONF
+
+// Deterministic samples (LCG + Box-Muller), as in the sorter's tests
+struct Rng {
+  uint64_t s = 12345;
+  double uniform() {
+    s = s * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((s >> 11) + 0.5) / 9007199254740992.0;  // (0, 1)
+  }
+  double normal(double mean, double sd) {
+    return mean + sd * sqrt(-2.0 * log(uniform())) * cos(6.283185307179586 * uniform());
+  }
+};
+
+// Platform model: trapezoid of the item moving over the platform, with
+// a dynamic gain, ringing excited on entry, slow zero drift
+// and HX711 noise
+struct Platform {
+  float noiseG = 0.5f;
+  float ringHz = 12.0f;
+  float ringRel = 0.02f;     // Ringing amplitude, fraction of the weight ...
+  float ringRelPerMs = 0.08f;  // ... plus this per m/s
+  float ringTauS = 0.15f;
+  float driftG = 2.0f;       // Zero drift amplitude (period DRIFT_S)
+  float gainPerMs = 0.02f;   // Dynamic gain per m/s
+};
+
+#define DRIFT_S 60.0
+
+struct Item {
+  float g;
+  float lengthMm;
+};
+
+// One item: idle gap, crossing at speedMmS, idle tail. Returns the
+// crossings the capture completed (normally one).
+struct Feed {
+  WimCapture cap;
+  WimEstimator est;
+  Platform pf;
+  Rng rng;
+  double tS = 0;
+  std::vector<WimSample> last;  // Last completed crossing, as wimVet
+  float lastZero = 0;
+
+  void setConfig(const WimConfig& c) {
+    cap.setConfig(c);
+    est.setConfig(c);
+  }
+
+  float reading(double t, const Item& it, double tIn, float v) {
+    double x = (t - tIn) * v;  // Leading edge past the platform start, mm
+    double on = std::min(x, (double)PLATFORM_MM) - std::max(x - it.lengthMm, 0.0);
+    double frac = std::max(on, 0.0) / it.lengthMm;
+    double vMs = v * 0.001;
+    double g = it.g * (1.0 + pf.gainPerMs * vMs) * frac;
+
+    // Ringing excited as the item moves on, carried by the mass on the
+    // platform (the empty platform rings far less)
+    double amp = it.g * (pf.ringRel + pf.ringRelPerMs * vMs);
+    if (t >= tIn) {
+      double dt = t - tIn;
+      g += frac * amp * exp(-dt / pf.ringTauS) * sin(6.283185307179586 * pf.ringHz * dt);
+    }
+    g += pf.driftG * sin(6.283185307179586 * t / DRIFT_S);
+    return (float)rng.normal(g, pf.noiseG);
+  }
+
+  int pass(const Item& it, float v, std::vector<WimResult>& out) {
+    const double dt = 1.0 / SPS;
+    double tIn = tS + 0.6;
+    double tEnd = tIn + (PLATFORM_MM + it.lengthMm) / v + 0.4;
+    int done = 0;
+    for (; tS < tEnd; tS += dt) {
+      WimSample s = {(uint32_t)(tS * 1e6), reading(tS, it, tIn, v)};
+      if (cap.add(s)) {
+        last.assign(cap.trace(), cap.trace() + cap.size());
+        lastZero = cap.zero();
+        out.push_back(est.estimate(cap.trace(), cap.size(), cap.zero(), cap.truncated()));
+        done++;
+      }
+    }
+    return done;
+  }
+};
+
+// Firmware defaults (src/main.cpp), with the belt speed under test and
+// the model's dynamic gain compensated
+static WimConfig config(float beltMmS) {
+  WimConfig c;
+  c.triggerG = 30.0f;
+  c.releaseG = 10.0f;
+  c.platformMm = PLATFORM_MM;
+  c.beltSpeedMmS = beltMmS;
+  c.speedComp = 0.02f;
+  c.tolG = 1.0f;
+  c.tolRel = 0.005f;
+  c.minPlateau = 4;
+  return c;
+}
+
+static Item drawItem(Rng& rng) {
+  Item it;
+  it.g = 40.0f + (float)rng.uniform() * 760.0f;         // 40-800 g
+  it.lengthMm = 40.0f + (float)rng.uniform() * 110.0f;  // 40-150 mm
+  return it;
+}
+
+struct Stats {
+  float mae, p95, maxErr, meanConf;
+  float verified;  // Share with conf >= WIM_MIN_CONF (sent as LM_WEIGHT)
+  float maxSent;   // Worst error among those
+  int sentOverTol; // ... and how many were outside the tolerance
+  int plateau;     // Results from the plateau mean
+};
+
+static Stats sweep(float speed, float beltCfg, int items) {
+  static Feed f;  // WimEstimator scratch is a few kB
+  f = Feed();
+  f.setConfig(config(beltCfg));
+  Rng items_rng;
+  items_rng.s = 777;
+
+  WimConfig c = config(beltCfg);
+  std::vector<float> err;
+  float maxSent = 0;
+  int sentOverTol = 0;
+  double conf = 0;
+  int ok = 0, plateau = 0;
+  for (int i = 0; i < items; i++) {
+    Item it = drawItem(items_rng);
+    std::vector<WimResult> r;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, f.pass(it, speed, r), "one crossing per item");
+    TEST_ASSERT_TRUE(r[0].ok);
+    err.push_back(fabsf(r[0].weightG - it.g));
+    conf += r[0].confidence;
+    if (r[0].confidence >= MIN_CONF) {
+      ok++;
+      maxSent = std::max(maxSent, err.back());
+      if (err.back() > c.tolG + c.tolRel * it.g) sentOverTol++;
+    }
+    if (r[0].plateauN >= 4) plateau++;
+  }
+  std::sort(err.begin(), err.end());
+  Stats s;
+  double sum = 0;
+  for (float e : err) sum += e;
+  s.mae = (float)(sum / err.size());
+  s.p95 = err[(size_t)(err.size() * 0.95)];
+  s.maxErr = err.back();
+  s.meanConf = (float)(conf / items);
+  s.verified = (float)ok / items;
+  s.maxSent = maxSent;
+  s.sentOverTol = sentOverTol;
+  s.plateau = plateau;
+  return s;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_accuracy_vs_speed(void) {
+  const float speeds[] = {100, 300, 600, 1000, 1500};
+  Stats st[5];
+
+  printf("\nWIM accuracy vs speed: %d items each, 40-800 g, 40-150 mm, %d SPS, "
+         "platform %.0f mm\n", ITEMS, SPS, PLATFORM_MM);
+  printf("%6s %8s %8s %8s %6s %6s %9s %9s %8s\n", "mm/s", "MAE g", "p95 g", "max g", "conf",
+         "sent", "sent max", ">tol", "plateau");
+  for (int k = 0; k < 5; k++) {
+    st[k] = sweep(speeds[k], speeds[k], ITEMS);
+    printf("%6.0f %8.2f %8.2f %8.2f %6.2f %5.0f%% %9.2f %9d %8d\n", speeds[k], st[k].mae,
+           st[k].p95, st[k].maxErr, st[k].meanConf, st[k].verified * 100, st[k].maxSent,
+           st[k].sentOverTol, st[k].plateau);
+  }
+
+  // Up to 600 mm/s (the nominal belt is 300) every item has a plateau,
+  // the mean is inside the static scale's 1 g tolerance and nearly
+  // every crossing is trusted
+  for (int k = 0; k <= 2; k++) {
+    TEST_ASSERT_EQUAL_INT(ITEMS, st[k].plateau);
+    TEST_ASSERT_LESS_THAN(0.5f, st[k].mae);
+    TEST_ASSERT_LESS_THAN(1.0f, st[k].p95);
+    TEST_ASSERT_GREATER_OR_EQUAL(0.98f, st[k].verified);
+  }
+  // Faster, the error grows and the confidence must say so: at 1.5 m/s
+  // nothing is trusted, and at no speed is a trusted crossing outside
+  // the tolerance
+  TEST_ASSERT_GREATER_THAN(st[1].mae * 5, st[4].mae);
+  TEST_ASSERT_LESS_THAN(st[1].meanConf / 2, st[4].meanConf);
+  TEST_ASSERT_LESS_THAN(0.05f, st[4].verified);
+  for (int k = 0; k < 5; k++) TEST_ASSERT_EQUAL_INT(0, st[k].sentOverTol);
+}
+
+void test_speed_mismatch_lowers_confidence(void) {
+  // Belt actually at 300 mm/s, configured 600: the measured speed gives
+  // it away even though the weight itself is still fine
+  Stats match = sweep(300, 300, 50);
+  Stats off = sweep(300, 600, 50);
+  printf("speed mismatch: conf %.2f -> %.2f, verified %.0f%% -> %.0f%%\n", match.meanConf,
+         off.meanConf, match.verified * 100, off.verified * 100);
+  TEST_ASSERT_LESS_THAN(match.meanConf, off.meanConf);
+  TEST_ASSERT_LESS_THAN(0.1f, off.verified);
+}
+
+// "wim" command output: WIM TRACE n zero=z / S tUs g ; ... / E / w=... ,
+// with an optional REF <gram> line anywhere in the file
+struct Recorded {
+  std::vector<WimSample> s;
+  float zero = 0;
+  float deviceG = NAN;   // w= printed by the firmware
+  float deviceConf = NAN;
+  float refG = NAN;
+};
+
+static std::vector<Recorded> parseTraces(const char* text) {
+  std::vector<Recorded> out;
+  Recorded cur;
+  bool inTrace = false;
+  float ref = NAN;
+  const char* p = text;
+  while (*p) {
+    const char* eol = strchr(p, '\n');
+    std::string line(p, eol ? (size_t)(eol - p) : strlen(p));
+    p = eol ? eol + 1 : p + line.size();
+
+    unsigned n;
+    float a, b;
+    unsigned long t;
+    if (sscanf(line.c_str(), "WIM TRACE %u zero=%f", &n, &a) == 2) {
+      cur = Recorded();
+      cur.zero = a;
+      inTrace = true;
+    } else if (inTrace && sscanf(line.c_str(), "S %lu %f", &t, &a) == 2) {
+      cur.s.push_back({(uint32_t)t, a});
+    } else if (inTrace && line.compare(0, 1, "E") == 0) {
+      inTrace = false;
+      out.push_back(cur);
+    } else if (!out.empty() && sscanf(line.c_str(), "w=%f g conf=%f", &a, &b) == 2) {
+      out.back().deviceG = a;
+      out.back().deviceConf = b;
+    } else if (sscanf(line.c_str(), "REF %f", &a) == 1) {
+      ref = a;
+    }
+  }
+  for (Recorded& r : out) r.refG = ref;
+  return out;
+}
+
+// A synthetic crossing printed the way inVetCanDong() does, so the
+// parser and the replay are checked without a recording
+void test_trace_format_round_trip(void) {
+  static Feed f;
+  f = Feed();
+  f.setConfig(config(300));
+  std::vector<WimResult> r;
+  Item it = {250.0f, 100.0f};
+  TEST_ASSERT_EQUAL_INT(1, f.pass(it, 300, r));
+
+  std::string text = "> wim\n";
+  char line[96];
+  snprintf(line, sizeof(line), "WIM TRACE %u zero=%.9g\n", (unsigned)f.last.size(), f.lastZero);
+  text += line;
+  const WimSample* s = f.last.data();
+  for (size_t i = 0; i < f.last.size(); i++) {
+    snprintf(line, sizeof(line), "S %lu %.9g  ; t=%.1f ms\n", (unsigned long)s[i].tUs, s[i].g,
+             (s[i].tUs - s[0].tUs) / 1000.0f);
+    text += line;
+  }
+  text += "E\n";
+  snprintf(line, sizeof(line), "w=%.2f g conf=%.2f plateau=%.2f/%u fit=%.2f noise=%.2f "
+           "v=%.0f mm/s gui LM_WEIGHT\n", r[0].weightG, r[0].confidence, r[0].plateauG,
+           (unsigned)r[0].plateauN, r[0].fitG, r[0].noiseG, r[0].speedMmS);
+  text += line;
+  text += "REF 250.0\n";
+
+  std::vector<Recorded> rec = parseTraces(text.c_str());
+  TEST_ASSERT_EQUAL_INT(1, (int)rec.size());
+  TEST_ASSERT_EQUAL_INT((int)f.last.size(), (int)rec[0].s.size());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 250.0f, rec[0].refG);
+
+  WimEstimator est;
+  est.setConfig(config(300));
+  WimResult again = est.estimate(rec[0].s.data(), rec[0].s.size(), rec[0].zero, false);
+  // Samples are printed exactly (%.9g), the result to 0.01
+  TEST_ASSERT_FLOAT_WITHIN(0.006f, rec[0].deviceG, again.weightG);
+  TEST_ASSERT_FLOAT_WITHIN(0.006f, rec[0].deviceConf, again.confidence);
+}
+
+static std::string readFile(const std::string& path) {
+  std::string text;
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp) return text;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) text.append(buf, n);
+  fclose(fp);
+  return text;
+}
+
+void test_recorded_traces(void) {
+  const char* dir = getenv("WIM_TRACE_DIR");
+  if (!dir) dir = "test/wim_traces";
+  DIR* d = opendir(dir);
+  if (!d) TEST_IGNORE_MESSAGE("no recorded traces (test/wim_traces)");
+
+  std::vector<std::string> files;
+  while (struct dirent* e = readdir(d)) {
+    std::string name = e->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) files.push_back(name);
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  if (files.empty()) TEST_IGNORE_MESSAGE("no recorded traces (test/wim_traces)");
+
+  // Belt speed as configured on the scale; the firmware default
+  WimEstimator est;
+  est.setConfig(config(300));
+  printf("\n%-24s %8s %8s %8s %8s %6s\n", "trace", "ref g", "device g", "host g", "err g",
+         "conf");
+  for (const std::string& name : files) {
+    std::string text = readFile(std::string(dir) + "/" + name);
+    for (const Recorded& rec : parseTraces(text.c_str())) {
+      TEST_ASSERT_TRUE_MESSAGE(rec.s.size() > 0, name.c_str());
+      WimResult r = est.estimate(rec.s.data(), rec.s.size(), rec.zero, false);
+      printf("%-24s %8.2f %8.2f %8.2f %8.2f %6.2f\n", name.c_str(), rec.refG, rec.deviceG,
+             r.weightG, rec.refG - r.weightG, r.confidence);
+      // Same estimator as on the scale (unless WIM_* parameters were
+      // changed there); a mismatch means the host build has drifted
+      if (!isnan(rec.deviceG)) {
+        TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.006f, rec.deviceG, r.weightG, name.c_str());
+      }
+    }
+  }
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_accuracy_vs_speed);
+  RUN_TEST(test_speed_mismatch_lowers_confidence);
+  RUN_TEST(test_trace_format_round_trip);
+  RUN_TEST(test_recorded_traces);
+  return UNITY_END();
+}
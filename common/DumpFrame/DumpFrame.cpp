@@ -0,0 +1,66 @@
+#include "DumpFrame.h"
+
+uint16_t dumpFrameCrc(const uint8_t* p, size_t n, uint16_t crc) {
+  for (size_t i = 0; i < n; i++) {
+    crc ^= (uint16_t)p[i] << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t dumpFrameEncode(uint32_t offset, const uint8_t* data, size_t n, uint8_t* out) {
+  if (n > DUMP_FRAME_MAX_DATA) return 0;
+
+  // Plain body first, right after the leading delimiter and COBS code
+  uint8_t* body = out + 2;
+  for (int k = 0; k < 4; k++) body[k] = (uint8_t)(offset >> (8 * k));
+  for (size_t i = 0; i < n; i++) body[4 + i] = data[i];
+  uint16_t crc = dumpFrameCrc(body, 4 + n);
+  body[4 + n] = (uint8_t)crc;
+  body[5 + n] = (uint8_t)(crc >> 8);
+  size_t len = n + 6;
+
+  // COBS in place: each zero becomes the distance to the next zero.
+  // The body is shorter than 254 bytes, so no extra block codes.
+  out[0] = 0x00;
+  size_t code = 1;  // Position of the pending code byte
+  for (size_t i = 0; i < len; i++) {
+    if (body[i] == 0) {
+      out[code] = (uint8_t)(2 + i - code);
+      code = 2 + i;
+    }
+  }
+  out[code] = (uint8_t)(2 + len - code);
+  out[2 + len] = 0x00;
+  return len + 3;
+}
+
+bool dumpFrameDecode(const uint8_t* seg, size_t n, uint32_t& offset, uint8_t* data,
+                     size_t& dataLen) {
+  uint8_t body[DUMP_FRAME_MAX_DATA + 6];
+  size_t len = 0;
+  size_t i = 0;
+  while (i < n) {
+    uint8_t code = seg[i++];
+    if (code == 0 || i + code - 1 > n) return false;
+    for (uint8_t k = 1; k < code; k++) {
+      if (len >= sizeof(body)) return false;
+      body[len++] = seg[i++];
+    }
+    if (code < 0xFF && i < n) {
+      if (len >= sizeof(body)) return false;
+      body[len++] = 0;
+    }
+  }
+  if (len < 6) return false;
+
+  uint16_t crc = (uint16_t)(body[len - 2] | (body[len - 1] << 8));
+  if (dumpFrameCrc(body, len - 2) != crc) return false;
+  offset = (uint32_t)body[0] | ((uint32_t)body[1] << 8) | ((uint32_t)body[2] << 16) |
+           ((uint32_t)body[3] << 24);
+  dataLen = len - 6;
+  for (size_t k = 0; k < dataLen; k++) data[k] = body[4 + k];
+  return true;
+}
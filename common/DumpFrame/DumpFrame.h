@@ -0,0 +1,38 @@
+/************************************************************
+ * DumpFrame - Framing for binary dumps on a shared serial port
+ *
+ * The sort path and the other tasks keep logging while a dump
+ * streams, so their lines end up between two dump writes. Each
+ * chunk is therefore sent as one self-contained frame, written
+ * with a single Serial.write() so no text can land inside it:
+ *
+ *   0x00 | COBS( offset u32 | data | CRC-16 u16 ) | 0x00
+ *
+ * COBS removes every 0x00 from the frame body and log text
+ * never contains 0x00, so a decoder splits the capture on 0x00
+ * and keeps the segments that decode with a valid CRC
+ * (CRC-16/CCITT-FALSE, little-endian fields); everything else is
+ * log text. `offset` is the byte position of `data` in the dump,
+ * so a missing or repeated frame is detected.
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DUMP_FRAME_MAX_DATA 240  // Body stays under 254 bytes: one COBS block
+#define DUMP_FRAME_OVERHEAD 9    // 2 delimiters, COBS code, offset, CRC
+#define DUMP_FRAME_MAX (DUMP_FRAME_MAX_DATA + DUMP_FRAME_OVERHEAD)
+
+uint16_t dumpFrameCrc(const uint8_t* p, size_t n, uint16_t crc = 0xFFFF);
+
+// Frame `n` (<= DUMP_FRAME_MAX_DATA) bytes into `out`, which must hold
+// DUMP_FRAME_MAX bytes. Returns the frame length (0 if n is too large).
+size_t dumpFrameEncode(uint32_t offset, const uint8_t* data, size_t n, uint8_t* out);
+
+// Decode one segment found between two 0x00 bytes. `data` must hold
+// DUMP_FRAME_MAX_DATA bytes. False for text or a corrupted frame.
+bool dumpFrameDecode(const uint8_t* seg, size_t n, uint32_t& offset, uint8_t* data,
+                     size_t& dataLen);
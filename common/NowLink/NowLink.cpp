@@ -0,0 +1,183 @@
+#include "NowLink.h"
+
+#include <string.h>
+
+// ---------------- LinkLatency ----------------
+
+void LinkLatency::add(uint32_t us) {
+  count++;
+  lastUs = us;
+  sumUs += us;
+  if (us < minUs) minUs = us;
+  if (us > maxUs) maxUs = us;
+}
+
+// ---------------- LoopbackLink (host stand-in) ----------------
+
+bool LoopbackLink::push(const LinkRx& rx) {
+  if (count_ >= LINK_QUEUE_LEN) {
+    dropped_++;
+    return false;
+  }
+  size_t tail = head_ + count_;
+  if (tail >= LINK_QUEUE_LEN) tail -= LINK_QUEUE_LEN;
+  ring_[tail] = rx;
+  count_++;
+  return true;
+}
+
+bool LoopbackLink::send(const LinkMsg& m) {
+  if (!peer_) return false;
+  sent_++;
+  if (dropEvery_ && (sent_ % dropEvery_) == 0) {
+    dropped_++;  // Lost on air: the sender does not know
+    return true;
+  }
+  LinkRx rx;
+  rx.msg = m;
+  rx.rxUs = peer_->clock_();
+  peer_->push(rx);
+  return true;
+}
+
+bool LoopbackLink::receive(LinkRx& out) {
+  if (count_ == 0) return false;
+  out = ring_[head_];
+  head_ = (head_ + 1 == LINK_QUEUE_LEN) ? 0 : head_ + 1;
+  count_--;
+  return true;
+}
+
+// ---------------- EspNowLink (device) ----------------
+
+#ifdef ESP_PLATFORM
+
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <esp_idf_version.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+static EspNowLink* s_link = nullptr;
+static StaticQueue_t s_queueCtrl;
+static uint8_t s_queueStorage[LINK_QUEUE_LEN * sizeof(LinkRx)];
+
+struct EspNowLinkCallbacks {
+  // Runs in the WiFi task: validate, stamp and queue. No heap, no wait.
+  // Another device on the channel (or a second Module 1) can send a
+  // valid-looking frame, so only the peer's are accepted.
+  static void recv(const uint8_t* src, const uint8_t* data, int len) {
+    if (!s_link) return;
+    if (!src || memcmp(src, s_link->peer_, sizeof(s_link->peer_)) != 0) {
+      s_link->rxForeign_ = s_link->rxForeign_ + 1;
+      return;
+    }
+    if (!linkMsgValid(data, len)) {
+      s_link->rxDropped_ = s_link->rxDropped_ + 1;
+      return;
+    }
+    LinkRx rx;
+    memcpy(&rx.msg, data, sizeof(LinkMsg));
+    rx.rxUs = (uint32_t)esp_timer_get_time();
+    if (xQueueSend((QueueHandle_t)s_link->queue_, &rx, 0) != pdTRUE) {
+      s_link->rxDropped_ = s_link->rxDropped_ + 1;
+    }
+  }
+
+  static void sent(esp_now_send_status_t status) {
+    if (!s_link) return;
+    if (status == ESP_NOW_SEND_SUCCESS) {
+      s_link->delivered_ = s_link->delivered_ + 1;
+    } else {
+      s_link->failed_ = s_link->failed_ + 1;
+    }
+  }
+};
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+static void onRecv(const esp_now_recv_info_t* info, const uint8_t* data, int len) {
+  EspNowLinkCallbacks::recv(info ? info->src_addr : nullptr, data, len);
+}
+#else
+static void onRecv(const uint8_t* mac, const uint8_t* data, int len) {
+  EspNowLinkCallbacks::recv(mac, data, len);
+}
+#endif
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+static void onSent(const esp_now_send_info_t* info, esp_now_send_status_t status) {
+  (void)info;
+  EspNowLinkCallbacks::sent(status);
+}
+#else
+static void onSent(const uint8_t* mac, esp_now_send_status_t status) {
+  (void)mac;
+  EspNowLinkCallbacks::sent(status);
+}
+#endif
+
+bool EspNowLink::begin(const uint8_t peerMac[6], uint8_t channel) {
+  memcpy(peer_, peerMac, sizeof(peer_));
+  queue_ = xQueueCreateStatic(LINK_QUEUE_LEN, sizeof(LinkRx), s_queueStorage, &s_queueCtrl);
+  s_link = this;
+
+  if (esp_now_init() != ESP_OK) return false;
+
+  esp_now_peer_info_t peer;
+  memset(&peer, 0, sizeof(peer));
+  memcpy(peer.peer_addr, peer_, sizeof(peer_));
+  peer.channel = channel;
+  peer.ifidx = WIFI_IF_STA;
+  peer.encrypt = false;
+  if (esp_now_add_peer(&peer) != ESP_OK) return false;
+
+  esp_now_register_recv_cb(onRecv);
+  esp_now_register_send_cb(onSent);
+  return true;
+}
+
+bool EspNowLink::send(const LinkMsg& m) {
+  return esp_now_send(peer_, (const uint8_t*)&m, sizeof(m)) == ESP_OK;
+}
+
+bool EspNowLink::receive(LinkRx& out) {
+  if (!queue_) return false;
+  return xQueueReceive((QueueHandle_t)queue_, &out, 0) == pdTRUE;
+}
+
+#else  // Host build
+
+bool EspNowLink::begin(const uint8_t peerMac[6], uint8_t channel) {
+  (void)peerMac;
+  (void)channel;
+  return true;
+}
+
+bool EspNowLink::send(const LinkMsg& m) {
+  (void)m;
+  sent_++;
+  return true;
+}
+
+bool EspNowLink::inject(const LinkRx& rx) {
+  if (count_ >= LINK_QUEUE_LEN) {
+    rxDropped_++;
+    return false;
+  }
+  size_t tail = head_ + count_;
+  if (tail >= LINK_QUEUE_LEN) tail -= LINK_QUEUE_LEN;
+  ring_[tail] = rx;
+  count_++;
+  return true;
+}
+
+bool EspNowLink::receive(LinkRx& out) {
+  if (count_ == 0) return false;
+  out = ring_[head_];
+  head_ = (head_ + 1 == LINK_QUEUE_LEN) ? 0 : head_ + 1;
+  count_--;
+  return true;
+}
+
+#endif  // ESP_PLATFORM
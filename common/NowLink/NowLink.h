@@ -0,0 +1,162 @@
+/************************************************************
+ * NowLink - Fixed-size datagram link between the two modules
+ *
+ * One LinkMsg per ESP-NOW frame, no byte stream and no text
+ * parsing. The receive callback drops frames from any MAC but
+ * the peer's, copies the rest into a preallocated FreeRTOS queue
+ * (static storage, no heap) and the control loop drains it with
+ * receive().
+ *
+ * Every weighed product takes one seq, as LM_WEIGHT or, when a
+ * weigh-in-motion estimate is not trusted, LM_UNVERIFIED: the
+ * receiver rejects that product but keeps the weights of the
+ * products behind it in step with the sequence.
+ *
+ * Latency: the receiver answers both with an LM_ACK
+ * that echoes the sender's txUs and reports how long the frame
+ * waited between the radio callback and the handler (holdUs).
+ * The sender then gets "send() call -> receiver handler" as
+ *   (rtt + holdUs) / 2
+ * without needing synchronised clocks.
+ *
+ * Shared by Module 1 and Module 2 (common/, see lib_extra_dirs
+ * in platformio.ini), so both sides always use the same wire format.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LINK_MAGIC     0xA5
+#define LINK_QUEUE_LEN 16
+
+enum LinkMsgType : uint8_t {
+  LM_HELLO      = 1,  // Connection probe, no payload
+  LM_WEIGHT     = 2,  // value = weight in mg
+  LM_ACK        = 3,  // seq/txUs echoed, value = receiver hold time (us)
+  LM_UNVERIFIED = 4,  // As LM_WEIGHT, estimate not trusted: reject the product
+};
+
+struct __attribute__((packed)) LinkMsg {
+  uint8_t  magic;  // LINK_MAGIC
+  uint8_t  type;   // LinkMsgType
+  uint16_t seq;    // Per-sender sequence number
+  uint32_t txUs;   // Sender micros() at send()
+  int32_t  value;
+  uint32_t aux;    // LM_WEIGHT/LM_UNVERIFIED: settle -> send age on the sender (us)
+};
+
+static_assert(sizeof(LinkMsg) == 16, "LinkMsg is part of the wire format");
+
+// Received message plus the receiver's micros() in the radio callback.
+struct LinkRx {
+  LinkMsg  msg;
+  uint32_t rxUs;
+};
+
+inline bool linkMsgValid(const uint8_t* data, int len) {
+  return len == (int)sizeof(LinkMsg) && data[0] == LINK_MAGIC;
+}
+
+class LinkTransport {
+public:
+  virtual ~LinkTransport() {}
+  // Non-blocking. False if the frame could not be queued for sending.
+  virtual bool send(const LinkMsg& m) = 0;
+  // Non-blocking. False if nothing is waiting.
+  virtual bool receive(LinkRx& out) = 0;
+};
+
+// Running latency figures in microseconds.
+struct LinkLatency {
+  uint32_t count = 0;
+  uint32_t lastUs = 0;
+  uint32_t minUs = 0xFFFFFFFFu;
+  uint32_t maxUs = 0;
+  uint64_t sumUs = 0;
+
+  void add(uint32_t us);
+  uint32_t avgUs() const { return count ? (uint32_t)(sumUs / count) : 0; }
+};
+
+// Host stand-in: two LoopbackLink objects connected back to back.
+// Frames are delivered in order into the peer's fixed ring; frames
+// beyond LINK_QUEUE_LEN are dropped like a full ESP-NOW queue.
+class LoopbackLink : public LinkTransport {
+public:
+  typedef uint32_t (*ClockFn)();
+
+  explicit LoopbackLink(ClockFn clock) : clock_(clock) {}
+  void connect(LoopbackLink* peer) { peer_ = peer; }
+  void setDropEvery(uint32_t n) { dropEvery_ = n; }  // 0 = lossless
+
+  bool send(const LinkMsg& m) override;
+  bool receive(LinkRx& out) override;
+
+  uint32_t dropped() const { return dropped_; }
+
+private:
+  bool push(const LinkRx& rx);
+
+  ClockFn clock_;
+  LoopbackLink* peer_ = nullptr;
+  LinkRx ring_[LINK_QUEUE_LEN];
+  size_t head_ = 0;
+  size_t count_ = 0;
+  uint32_t sent_ = 0;
+  uint32_t dropEvery_ = 0;
+  uint32_t dropped_ = 0;
+};
+
+#ifdef ESP_PLATFORM
+// ESP-NOW transport using the raw send/receive callbacks.
+// Only one instance may exist (the callbacks are plain C functions).
+class EspNowLink : public LinkTransport {
+public:
+  // WiFi must already be in STA mode on `channel`.
+  bool begin(const uint8_t peerMac[6], uint8_t channel);
+
+  bool send(const LinkMsg& m) override;
+  bool receive(LinkRx& out) override;
+
+  uint32_t delivered() const { return delivered_; }  // MAC-level ack
+  uint32_t failed() const { return failed_; }
+  uint32_t rxDropped() const { return rxDropped_; }  // Queue full / bad frame
+  uint32_t rxForeign() const { return rxForeign_; }  // Sent by another MAC
+
+private:
+  friend struct EspNowLinkCallbacks;  // Radio callbacks, see NowLink.cpp
+
+  uint8_t peer_[6];
+  void* queue_ = nullptr;
+  volatile uint32_t delivered_ = 0;
+  volatile uint32_t failed_ = 0;
+  volatile uint32_t rxDropped_ = 0;
+  volatile uint32_t rxForeign_ = 0;
+};
+#else
+// Host build (native env): same interface as the device transport so
+// the firmware compiles unchanged. The replay driver or a test injects
+// received frames; sent frames are only counted.
+class EspNowLink : public LinkTransport {
+public:
+  bool begin(const uint8_t peerMac[6], uint8_t channel);
+
+  bool send(const LinkMsg& m) override;
+  bool receive(LinkRx& out) override;
+  bool inject(const LinkRx& rx);  // False (and counted) when the queue is full
+
+  uint32_t sent() const { return sent_; }
+  uint32_t delivered() const { return sent_; }
+  uint32_t failed() const { return 0; }
+  uint32_t rxDropped() const { return rxDropped_; }
+  uint32_t rxForeign() const { return 0; }
+
+private:
+  LinkRx ring_[LINK_QUEUE_LEN];
+  size_t head_ = 0;
+  size_t count_ = 0;
+  uint32_t sent_ = 0;
+  uint32_t rxDropped_ = 0;
+};
+#endif
@@ -0,0 +1,261 @@
+#include "ParamRegistry.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// ---------------- ParamRegistry ----------------
+
+ParamStatus ParamRegistry::add(const char* name, ParamType t, void* p, float minV, float maxV) {
+  if (count_ >= MAX_PARAMS) {
+    if (!addFailed_) addFailed_ = name;
+    return PS_FULL;
+  }
+  ParamInfo& pi = params_[count_++];
+  pi.name = name;
+  pi.type = t;
+  pi.ptr = p;
+  pi.minV = minV;
+  pi.maxV = maxV;
+  pi.dirty = false;
+  if (t == PT_FLOAT) {
+    pi.def.f = *(float*)p;
+  } else {
+    pi.def.i = *(int*)p;
+  }
+  pi.pending = pi.def;
+  return PS_OK;
+}
+
+ParamStatus ParamRegistry::addFloat(const char* name, float* p, float minV, float maxV) {
+  return add(name, PT_FLOAT, p, minV, maxV);
+}
+
+ParamStatus ParamRegistry::addInt(const char* name, int* p, int minV, int maxV) {
+  return add(name, PT_INT, p, (float)minV, (float)maxV);
+}
+
+int ParamRegistry::find(const char* name) const {
+  for (size_t i = 0; i < count_; i++) {
+    if (strcasecmp(params_[i].name, name) == 0) return (int)i;
+  }
+  return -1;
+}
+
+bool ParamRegistry::inRange(const ParamInfo& pi, ParamValue v) const {
+  float x = (pi.type == PT_FLOAT) ? v.f : (float)v.i;
+  return x >= pi.minV && x <= pi.maxV;  // NaN fails both
+}
+
+ParamStatus ParamRegistry::set(const char* name, const char* text) {
+  int idx = find(name);
+  if (idx < 0) return PS_UNKNOWN;
+  if (!text || !*text) return PS_BAD_VALUE;
+
+  ParamValue v;
+  char* end = nullptr;
+  errno = 0;
+  if (params_[idx].type == PT_FLOAT) {
+    v.f = strtof(text, &end);
+  } else {
+    long l = strtol(text, &end, 10);
+    if (l < -2147483647L || l > 2147483647L) return PS_OUT_OF_RANGE;
+    v.i = (int)l;
+  }
+  if (end == text || *end != '\0' || errno == ERANGE) return PS_BAD_VALUE;
+  return setValue((size_t)idx, v);
+}
+
+ParamStatus ParamRegistry::setValue(size_t i, ParamValue v) {
+  if (i >= count_) return PS_UNKNOWN;
+  ParamInfo& pi = params_[i];
+  if (!inRange(pi, v)) return PS_OUT_OF_RANGE;
+  pi.pending = v;
+  if (!pi.dirty) {
+    pi.dirty = true;
+    pendingCount_++;
+  }
+  return PS_OK;
+}
+
+void ParamRegistry::stageDefaults() {
+  for (size_t i = 0; i < count_; i++) setValue(i, params_[i].def);
+}
+
+ParamValue ParamRegistry::staged(size_t i) const {
+  return params_[i].dirty ? params_[i].pending : value(i);
+}
+
+float ParamRegistry::stagedFloat(const char* name) const {
+  int idx = find(name);
+  if (idx < 0) return NAN;
+  ParamValue v = staged((size_t)idx);
+  return params_[idx].type == PT_FLOAT ? v.f : (float)v.i;
+}
+
+size_t ParamRegistry::applyPending() {
+  size_t applied = 0;
+  if (pendingCount_ == 0) return 0;
+  rejectReason_ = check_ ? check_(*this) : nullptr;
+  if (rejectReason_) {
+    for (size_t i = 0; i < count_; i++) params_[i].dirty = false;
+    pendingCount_ = 0;
+    return 0;
+  }
+  for (size_t i = 0; i < count_; i++) {
+    ParamInfo& pi = params_[i];
+    if (!pi.dirty) continue;
+    if (pi.type == PT_FLOAT) {
+      *(float*)pi.ptr = pi.pending.f;
+    } else {
+      *(int*)pi.ptr = pi.pending.i;
+    }
+    pi.dirty = false;
+    applied++;
+  }
+  pendingCount_ = 0;
+  return applied;
+}
+
+ParamValue ParamRegistry::value(size_t i) const {
+  ParamValue v;
+  if (params_[i].type == PT_FLOAT) {
+    v.f = *(const float*)params_[i].ptr;
+  } else {
+    v.i = *(const int*)params_[i].ptr;
+  }
+  return v;
+}
+
+void ParamRegistry::format(size_t i, char* buf, size_t n) const {
+  ParamValue v = value(i);
+  if (params_[i].type == PT_FLOAT) {
+    snprintf(buf, n, "%.3f", (double)v.f);
+  } else {
+    snprintf(buf, n, "%d", v.i);
+  }
+}
+
+void ParamRegistry::nvsKey(const char* name, char* buf, size_t n) {
+  uint32_t h = 2166136261u;
+  for (const char* c = name; *c; c++) {
+    h ^= (uint8_t)*c;
+    h *= 16777619u;
+  }
+  snprintf(buf, n, "p%08lx", (unsigned long)h);
+}
+
+// ---------------- CommandLine ----------------
+
+bool CommandLine::feed(char c) {
+  if (ready_) {
+    // Previous line consumed, start a new one
+    ready_ = false;
+    len_ = 0;
+    overflow_ = false;
+  }
+
+  if (c != '\n' && c != '\r') {
+    if (len_ < MAX_LEN) {
+      buf_[len_++] = c;
+    } else {
+      overflow_ = true;
+    }
+    return false;
+  }
+
+  if (len_ == 0) return false;  // Empty line or second half of CRLF
+  if (overflow_) {
+    // Too long to be a valid command: drop it
+    len_ = 0;
+    overflow_ = false;
+    return false;
+  }
+  buf_[len_] = '\0';
+  ready_ = true;
+
+  // Tokenize in place on spaces/tabs
+  argc_ = 0;
+  char* p = buf_;
+  while (*p && argc_ < (int)MAX_ARGS) {
+    while (*p == ' ' || *p == '\t') *p++ = '\0';
+    if (!*p) break;
+    argv_[argc_++] = p;
+    while (*p && *p != ' ' && *p != '\t') p++;
+  }
+  return argc_ > 0;
+}
+
+// ---------------- Protocol ----------------
+
+static const char* statusText(ParamStatus s) {
+  switch (s) {
+    case PS_OK:           return "OK";
+    case PS_UNKNOWN:      return "ERR unknown parameter";
+    case PS_BAD_VALUE:    return "ERR bad value";
+    case PS_OUT_OF_RANGE: return "ERR out of range";
+    case PS_FULL:         return "ERR registry full";
+  }
+  return "ERR";
+}
+
+bool handleParamCommand(ParamRegistry& reg, const CommandLine& cmd, LineOut out) {
+  char line[80];
+  char val[20];
+  const char* verb = cmd.argv(0);
+
+  if (strcasecmp(verb, "list") == 0) {
+    for (size_t i = 0; i < reg.count(); i++) {
+      const ParamInfo& pi = reg.info(i);
+      reg.format(i, val, sizeof(val));
+      snprintf(line, sizeof(line), "%s=%s [%g..%g]%s", pi.name, val,
+               (double)pi.minV, (double)pi.maxV, pi.dirty ? " (pending)" : "");
+      out(line);
+    }
+    out("OK");
+    return true;
+  }
+
+  if (strcasecmp(verb, "get") == 0) {
+    int idx = reg.find(cmd.argv(1));
+    if (idx < 0) {
+      out(statusText(PS_UNKNOWN));
+      return true;
+    }
+    reg.format((size_t)idx, val, sizeof(val));
+    snprintf(line, sizeof(line), "OK %s=%s", reg.info((size_t)idx).name, val);
+    out(line);
+    return true;
+  }
+
+  if (strcasecmp(verb, "set") == 0) {
+    ParamStatus st = reg.set(cmd.argv(1), cmd.argv(2));
+    if (st != PS_OK) {
+      int idx = reg.find(cmd.argv(1));
+      if (st == PS_OUT_OF_RANGE && idx >= 0) {
+        const ParamInfo& pi = reg.info((size_t)idx);
+        snprintf(line, sizeof(line), "%s %g..%g", statusText(st),
+                 (double)pi.minV, (double)pi.maxV);
+        out(line);
+      } else {
+        out(statusText(st));
+      }
+      return true;
+    }
+    snprintf(line, sizeof(line), "OK %s=%s (pending)",
+             reg.info((size_t)reg.find(cmd.argv(1))).name, cmd.argv(2));
+    out(line);
+    return true;
+  }
+
+  if (strcasecmp(verb, "defaults") == 0) {
+    reg.stageDefaults();
+    out("OK defaults (pending)");
+    return true;
+  }
+
+  return false;
+}
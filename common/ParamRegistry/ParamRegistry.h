@@ -0,0 +1,141 @@
+/************************************************************
+ * ParamRegistry - Runtime tuning parameters
+ *
+ * Typed (float / int) parameters registered by name with a
+ * valid range and their compiled-in default. `set` only stages
+ * a pending value; the owner calls applyPending() at a safe
+ * point of its state machine so a knob never changes in the
+ * middle of a measurement or a sort.
+ *
+ * Rules between parameters (e.g. BIN1_MAX_G < BIN2_MAX_G) go in
+ * a ParamCheck. applyPending() runs it on the staged set and, if
+ * it fails, discards every staged value: a set of related changes
+ * is applied whole or not at all, whatever order it was typed in.
+ *
+ * CommandLine + handleParamCommand() implement the serial
+ * protocol (one command per line, space separated):
+ *   list                  NAME=value [min..max] for every param
+ *   get NAME              OK NAME=value
+ *   set NAME VALUE        OK NAME=value (pending) | ERR ...
+ *   defaults              stage every compiled-in default
+ * Persistence (save/load) is done by the caller using nvsKey().
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum ParamType : uint8_t { PT_FLOAT, PT_INT };
+
+enum ParamStatus : uint8_t {
+  PS_OK,
+  PS_UNKNOWN,       // No parameter with that name
+  PS_BAD_VALUE,     // Not a number (or not an integer for PT_INT)
+  PS_OUT_OF_RANGE,
+  PS_FULL,          // Registry capacity reached
+};
+
+union ParamValue {
+  float f;
+  int i;
+};
+
+class ParamRegistry;
+
+// Cross-parameter rule. Reads the staged set (stagedFloat()) and
+// returns nullptr if it is consistent, else a short reason.
+typedef const char* (*ParamCheck)(const ParamRegistry& reg);
+
+struct ParamInfo {
+  const char* name;
+  ParamType type;
+  void* ptr;        // float* or int*, the live variable
+  float minV;
+  float maxV;
+  ParamValue def;   // Value at registration
+  ParamValue pending;
+  bool dirty;
+};
+
+class ParamRegistry {
+public:
+  static const size_t MAX_PARAMS = 24;
+
+  ParamStatus addFloat(const char* name, float* p, float minV, float maxV);
+  ParamStatus addInt(const char* name, int* p, int minV, int maxV);
+
+  // First name add*() could not register (PS_FULL), nullptr if none.
+  // Checked once after registration: such a parameter can never be set.
+  const char* addFailed() const { return addFailed_; }
+
+  size_t count() const { return count_; }
+  const ParamInfo& info(size_t i) const { return params_[i]; }
+  int find(const char* name) const;  // -1 if unknown
+
+  // Parse and range-check `text`, then stage it.
+  ParamStatus set(const char* name, const char* text);
+  // Stage an already-typed value (used when loading from NVS).
+  ParamStatus setValue(size_t i, ParamValue v);
+  void stageDefaults();
+
+  void setCheck(ParamCheck check) { check_ = check; }
+  // Value after applyPending(): the staged one if any, else the live one.
+  ParamValue staged(size_t i) const;
+  float stagedFloat(const char* name) const;  // Either type; NaN if unknown
+
+  bool hasPending() const { return pendingCount_ > 0; }
+  // Copy every staged value into its live variable. Returns how many
+  // were applied so the caller can refresh derived settings. If the
+  // check fails nothing is applied, the staged set is dropped and
+  // rejectReason() says why (nullptr after a successful apply).
+  size_t applyPending();
+  const char* rejectReason() const { return rejectReason_; }
+
+  // Live value as text ("123" / "12.500").
+  void format(size_t i, char* buf, size_t n) const;
+  ParamValue value(size_t i) const;
+
+  // NVS keys are limited to 15 chars: use "p" + FNV-1a hash of the name.
+  static void nvsKey(const char* name, char* buf, size_t n);
+
+private:
+  ParamStatus add(const char* name, ParamType t, void* p, float minV, float maxV);
+  bool inRange(const ParamInfo& pi, ParamValue v) const;
+
+  ParamInfo params_[MAX_PARAMS];
+  size_t count_ = 0;
+  size_t pendingCount_ = 0;
+  ParamCheck check_ = nullptr;
+  const char* rejectReason_ = nullptr;
+  const char* addFailed_ = nullptr;
+};
+
+// Fixed-size line assembler and tokenizer (no heap).
+class CommandLine {
+public:
+  static const size_t MAX_LEN = 64;
+  static const size_t MAX_ARGS = 4;
+
+  // Feed one character. Returns true when a non-empty line is ready;
+  // argc()/argv() are valid until the next call to feed().
+  bool feed(char c);
+
+  int argc() const { return argc_; }
+  const char* argv(int i) const { return (i < argc_) ? argv_[i] : ""; }
+
+private:
+  char buf_[MAX_LEN + 1];
+  size_t len_ = 0;
+  bool overflow_ = false;
+  bool ready_ = false;
+  int argc_ = 0;
+  const char* argv_[MAX_ARGS];
+};
+
+typedef void (*LineOut)(const char* line);
+
+// Handles list/get/set/defaults. Returns false if argv[0] is not a
+// parameter command so the caller can try its own commands.
+bool handleParamCommand(ParamRegistry& reg, const CommandLine& cmd, LineOut out);
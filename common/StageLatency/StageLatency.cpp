@@ -0,0 +1,37 @@
+#include "StageLatency.h"
+
+#include <algorithm>
+
+void StageLatency::begin(const char* const* names, size_t stages) {
+  names_ = names;
+  stages_ = (stages > MAX_STAGES) ? MAX_STAGES : stages;
+  clear();
+}
+
+void StageLatency::clear() {
+  for (size_t i = 0; i < MAX_STAGES; i++) count_[i] = 0;
+}
+
+void StageLatency::add(size_t stage, uint32_t us) {
+  if (stage >= stages_) return;
+  samples_[stage][count_[stage] % WINDOW] = us;
+  count_[stage]++;
+}
+
+bool StageLatency::summary(size_t stage, Summary& out) const {
+  if (stage >= stages_ || count_[stage] == 0) return false;
+
+  size_t n = (count_[stage] < WINDOW) ? count_[stage] : WINDOW;
+  uint32_t sorted[WINDOW];
+  std::copy(samples_[stage], samples_[stage] + n, sorted);
+  std::sort(sorted, sorted + n);
+
+  // Nearest-rank percentile
+  auto rank = [n](uint32_t pct) { return (n * pct + 99) / 100 - 1; };
+  out.count = count_[stage];
+  out.p50 = sorted[rank(50)];
+  out.p95 = sorted[rank(95)];
+  out.p99 = sorted[rank(99)];
+  out.max = sorted[n - 1];
+  return true;
+}
@@ -0,0 +1,46 @@
+/************************************************************
+ * StageLatency - Rolling p50/p95/p99 per pipeline stage
+ *
+ * Each stage keeps the last WINDOW samples (microseconds) in a
+ * fixed ring, so add() is O(1) and memory is constant.
+ * Percentiles are computed only on demand (serial "lat"
+ * command) from a sorted copy of the window.
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class StageLatency {
+public:
+  static const size_t MAX_STAGES = 6;
+  static const size_t WINDOW = 256;
+
+  struct Summary {
+    uint32_t count;  // Samples ever added
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;    // Max within the window
+  };
+
+  // `names` must outlive the object (string literals).
+  void begin(const char* const* names, size_t stages);
+
+  void add(size_t stage, uint32_t us);
+  void clear();
+
+  size_t stages() const { return stages_; }
+  const char* name(size_t stage) const { return names_[stage]; }
+
+  // False if the stage has no samples yet.
+  bool summary(size_t stage, Summary& out) const;
+
+private:
+  const char* const* names_ = nullptr;
+  size_t stages_ = 0;
+  uint32_t samples_[MAX_STAGES][WINDOW];
+  uint32_t count_[MAX_STAGES] = {};
+};
@@ -0,0 +1,53 @@
+#include "TraceCapture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "DumpFrame.h"
+
+bool loadTraceCapture(const char* path, std::vector<TraceRecord>& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  std::string data;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+  fclose(f);
+
+  size_t pos = data.rfind("TRACE BEGIN ");
+  if (pos == std::string::npos) return false;
+  unsigned count = 0, recSize = 0;
+  if (sscanf(data.c_str() + pos, "TRACE BEGIN %u %u", &count, &recSize) != 2 ||
+      recSize != sizeof(TraceRecord)) {
+    return false;
+  }
+  pos = data.find('\n', pos);
+  if (pos == std::string::npos) return false;
+
+  // Frames between 0x00 delimiters; text, damaged and repeated frames are skipped
+  size_t total = (size_t)count * recSize;
+  std::string body;
+  uint8_t chunk[DUMP_FRAME_MAX_DATA];
+  while (body.size() < total) {
+    size_t start = data.find('\0', pos);
+    if (start == std::string::npos) return false;
+    size_t end = data.find('\0', start + 1);
+    if (end == std::string::npos) return false;
+    uint32_t offset;
+    size_t len;
+    if (!dumpFrameDecode((const uint8_t*)data.data() + start + 1, end - start - 1, offset,
+                         chunk, len)) {
+      pos = start + 1;
+      continue;
+    }
+    pos = end;
+    if (offset + len <= body.size()) continue;  // Repeated frame
+    if (offset != body.size()) return false;    // Lost frame
+    body.append((const char*)chunk, len);
+  }
+
+  out.resize(count);
+  if (count) memcpy(out.data(), body.data(), total);
+  return true;
+}
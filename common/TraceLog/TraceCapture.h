@@ -0,0 +1,17 @@
+/************************************************************
+ * TraceCapture - Load a trace dump on the host
+ *
+ * Reads the raw serial capture of a 'd' command (either module)
+ * and reassembles the last TRACE block from its DumpFrame frames,
+ * skipping log lines and repeated frames. Used by the replay
+ * tools of both native envs; tools/dump_to_csv.py does the same
+ * in Python.
+ ************************************************************/
+#pragma once
+
+#include <vector>
+
+#include "TraceLog.h"
+
+// False if there is no complete TRACE block or a frame is missing.
+bool loadTraceCapture(const char* path, std::vector<TraceRecord>& out);
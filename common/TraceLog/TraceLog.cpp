@@ -0,0 +1,84 @@
+#include "TraceLog.h"
+
+#include <string.h>
+
+void TraceLog::attach(TraceRecord* buf, size_t capacity) {
+  buf_ = buf;
+  cap_ = buf ? capacity : 0;
+  enabled_ = false;
+  clear();
+}
+
+void TraceLog::clear() {
+  head_ = 0;
+  count_ = 0;
+  overwritten_ = 0;
+}
+
+void TraceLog::record(uint32_t tUs, uint8_t kind, uint8_t arg, int32_t value) {
+  if (!enabled_) return;
+
+  TraceRecord& r = buf_[head_];
+  r.tUs = tUs;
+  r.kind = kind;
+  r.arg = arg;
+  r.value = value;
+
+  head_ = (head_ + 1 == cap_) ? 0 : head_ + 1;
+  if (count_ < cap_) {
+    count_++;
+  } else {
+    overwritten_++;
+  }
+}
+
+const TraceRecord& TraceLog::at(size_t i) const {
+  size_t start = (count_ < cap_) ? 0 : head_;
+  size_t idx = start + i;
+  if (idx >= cap_) idx -= cap_;
+  return buf_[idx];
+}
+
+size_t TraceLog::copyBytes(size_t byteOffset, uint8_t* dst, size_t maxBytes) const {
+  const size_t total = sizeBytes();
+  if (byteOffset >= total) return 0;
+  if (maxBytes > total - byteOffset) maxBytes = total - byteOffset;
+
+  // Logical order is [start .. cap) then [0 .. head) once wrapped
+  const size_t start = (count_ < cap_) ? 0 : head_;
+  const uint8_t* base = reinterpret_cast<const uint8_t*>(buf_);
+  const size_t capBytes = cap_ * sizeof(TraceRecord);
+
+  size_t phys = start * sizeof(TraceRecord) + byteOffset;
+  if (phys >= capBytes) phys -= capBytes;
+
+  size_t first = capBytes - phys;
+  if (first > maxBytes) first = maxBytes;
+  memcpy(dst, base + phys, first);
+  if (first < maxBytes) {
+    memcpy(dst + first, base, maxBytes - first);
+  }
+  return maxBytes;
+}
+
+uint32_t TraceCursor::nextTimeUs() const {
+  if (done()) return 0;
+  return recs_[pos_].tUs - recs_[0].tUs;  // unsigned math handles micros() wrap
+}
+
+bool TraceCursor::nextDue(uint32_t nowUs, TraceRecord& out) {
+  if (done() || nextTimeUs() > nowUs) return false;
+  out = recs_[pos_++];
+  return true;
+}
+
+bool TraceCursor::nextOfKind(uint8_t kind, TraceRecord& out) {
+  while (!done()) {
+    const TraceRecord& r = recs_[pos_++];
+    if (r.kind == kind) {
+      out = r;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,99 @@
+/************************************************************
+ * TraceLog - Compact binary trace of raw inputs/outputs
+ *
+ * Records raw sensor readings, button edges and ESP-NOW frames
+ * as fixed 10-byte records into a caller-provided ring buffer
+ * (PSRAM on the ESP32-S3, heap otherwise). When the buffer is
+ * full the oldest records are overwritten.
+ *
+ * The dump format is the raw array of TraceRecord in
+ * little-endian order, oldest first (sent in DumpFrame frames).
+ * TraceCursor walks a dumped (or live) trace in order so the
+ * native build can feed the same inputs back into loop() and
+ * reproduce a run (Module 2: native/TraceReplay.h).
+ *
+ * No Arduino dependency - builds on the host as well.
+ ************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Record kinds. Keep the numbering stable: dumps are decoded offline.
+enum TraceKind : uint8_t {
+  TR_NONE      = 0,
+  TR_HX711_RAW = 1,  // arg: samples averaged, value: raw HX711 counts
+  TR_SR04      = 2,  // value: echo distance in 0.1 mm, -1 = no echo
+  TR_BUTTON    = 3,  // arg: GPIO pin, value: raw level (before debounce)
+  TR_NOW_TX    = 4,  // arg: frame type, value: payload (weight in mg)
+  TR_NOW_RX    = 5,  // arg: frame type, value: payload (weight in mg)
+  TR_MARK      = 6,  // arg: user tag, value: free
+  TR_NOW_SEQ   = 7,  // arg: frame type, value: seq of the TR_NOW_RX/TX just before
+};
+
+struct __attribute__((packed)) TraceRecord {
+  uint32_t tUs;    // micros() at capture (wraps after ~71 min)
+  uint8_t  kind;   // TraceKind
+  uint8_t  arg;
+  int32_t  value;
+};
+
+static_assert(sizeof(TraceRecord) == 10, "TraceRecord must stay 10 bytes");
+
+class TraceLog {
+public:
+  // Use `buf` (capacity records) as storage. Recording starts disabled.
+  void attach(TraceRecord* buf, size_t capacity);
+
+  void setEnabled(bool on) { enabled_ = on && buf_ != nullptr; }
+  bool enabled() const { return enabled_; }
+  void clear();
+
+  // O(1) append; overwrites the oldest record when full.
+  void record(uint32_t tUs, uint8_t kind, uint8_t arg, int32_t value);
+
+  size_t size() const { return count_; }
+  size_t capacity() const { return cap_; }
+  uint32_t overwritten() const { return overwritten_; }
+
+  // i = 0 is the oldest record still in the buffer.
+  const TraceRecord& at(size_t i) const;
+
+  // Byte view of the trace in logical (oldest-first) order, used to
+  // stream a dump in small chunks without a second buffer.
+  size_t sizeBytes() const { return count_ * sizeof(TraceRecord); }
+  size_t copyBytes(size_t byteOffset, uint8_t* dst, size_t maxBytes) const;
+
+private:
+  TraceRecord* buf_ = nullptr;
+  size_t cap_ = 0;
+  size_t head_ = 0;   // next write slot
+  size_t count_ = 0;
+  uint32_t overwritten_ = 0;
+  bool enabled_ = false;
+};
+
+// Walks a record array in order, e.g. a dump loaded on the host.
+// The replay driver peeks at the next record, advances virtual time
+// to it and feeds it to the matching input stub.
+class TraceCursor {
+public:
+  TraceCursor(const TraceRecord* recs, size_t count) : recs_(recs), n_(count) {}
+
+  bool done() const { return pos_ >= n_; }
+  // Next record without consuming it, nullptr when done.
+  const TraceRecord* peek() const { return done() ? nullptr : &recs_[pos_]; }
+  void skip() { if (!done()) pos_++; }
+  // Relative time of the next record (first record = 0), handles wrap.
+  uint32_t nextTimeUs() const;
+  // Returns the next record if it is due at relative time `nowUs`.
+  bool nextDue(uint32_t nowUs, TraceRecord& out);
+  // Next record of the given kind regardless of time (skips others).
+  bool nextOfKind(uint8_t kind, TraceRecord& out);
+  void rewind() { pos_ = 0; }
+
+private:
+  const TraceRecord* recs_;
+  size_t n_;
+  size_t pos_ = 0;
+};
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Decode binary dumps captured from the serial port into CSV.
+
+Handles the blocks printed by both modules:
+  TRACE BEGIN <count> <record size> <overwritten> ... TRACE END
+  LEDGER BEGIN <count> <entry size> <first index> ... LEDGER END
+
+TRACE and LEDGER data come in frames (see common/DumpFrame/DumpFrame.h):
+0x00, COBS(offset u32 | data | CRC-16), 0x00. Log lines printed
+while the dump runs sit between frames and are skipped.
+
+Capture the port raw (no line-ending or echo filters), e.g.
+  cat /dev/ttyUSB0 > log.bin         (then send 'l' or 'd')
+and run:
+  python3 tools/dump_to_csv.py log.bin > ledger.csv
+
+Layouts must match TraceLog.h, SortLedger.h and DumpFrame.h.
+"""
+import struct
+import sys
+
+TRACE_FMT = "<IBBi"       # tUs, kind, arg, value
+LEDGER_FMT = "<IiIIBB"    # seq, weightMg, detectMs, divertMs, bin, outcome
+
+TRACE_KINDS = {0: "none", 1: "hx711_raw", 2: "sr04", 3: "button",
+               4: "now_tx", 5: "now_rx", 6: "mark", 7: "now_seq"}
+LEDGER_OUTCOMES = {0: "lost", 1: "sorted_link", 2: "sorted_manual",
+                   3: "reject_no_weight", 4: "reject_lost_frame",
+                   5: "unverified_preempted", 6: "reject_unverified"}
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(seg):
+    out = bytearray()
+    i = 0
+    while i < len(seg):
+        code = seg[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(seg):
+            return None
+        out += seg[i:i + code - 1]
+        i += code - 1
+        if code < 0xFF and i < len(seg):
+            out.append(0)
+    return bytes(out)
+
+
+def frame(seg):
+    """(offset, data) for a valid frame, None for log text."""
+    body = cobs_decode(seg)
+    if body is None or len(body) < 6:
+        return None
+    if crc16(body[:-2]) != struct.unpack_from("<H", body, len(body) - 2)[0]:
+        return None
+    return struct.unpack_from("<I", body)[0], body[4:-2]
+
+
+def framed_body(data, pos, total):
+    """Reassemble `total` bytes of frames from data[pos:].
+
+    Returns (body, end position) or (None, pos) if truncated."""
+    body = bytearray()
+    while len(body) < total:
+        start = data.find(b"\x00", pos)
+        if start < 0:
+            return None, pos
+        end = data.find(b"\x00", start + 1)
+        if end < 0:
+            return None, pos
+        f = frame(data[start + 1:end])
+        if f is None:
+            pos = start + 1  # Text (or a damaged frame) between frames
+            continue
+        offset, chunk = f
+        if offset < len(body):
+            pos = end + 1  # Repeated frame
+            continue
+        if offset > len(body):
+            sys.stderr.write("frame at offset %u, expected %u\n" % (offset, len(body)))
+            return None, pos
+        body += chunk
+        pos = end + 1
+    return bytes(body), pos
+
+
+def blocks(data, tag):
+    begin = tag + b" BEGIN "
+    pos = 0
+    while True:
+        start = data.find(begin, pos)
+        if start < 0:
+            return
+        eol = data.index(b"\n", start)
+        fields = data[start + len(begin):eol].split()
+        count, size = int(fields[0]), int(fields[1])
+        body, end = framed_body(data, eol + 1, count * size)
+        if body is None or len(body) < count * size:
+            sys.stderr.write("%s block truncated\n" % tag.decode())
+            return
+        yield fields, size, body
+        pos = end
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: dump_to_csv.py <capture file>")
+    data = open(sys.argv[1], "rb").read()
+    out = sys.stdout
+
+    for _, size, body in blocks(data, b"LEDGER"):
+        assert size == struct.calcsize(LEDGER_FMT)
+        out.write("seq,weight_g,bin,detect_ms,divert_ms,outcome\n")
+        for seq, mg, det, div, b, oc in struct.iter_unpack(LEDGER_FMT, body):
+            out.write("%u,%.3f,%u,%u,%u,%s\n" % (seq, mg / 1000.0, b, det, div,
+                                                LEDGER_OUTCOMES.get(oc, oc)))
+
+    for _, size, body in blocks(data, b"TRACE"):
+        assert size == struct.calcsize(TRACE_FMT)
+        out.write("t_us,kind,arg,value\n")
+        for t, kind, arg, val in struct.iter_unpack(TRACE_FMT, body):
+            out.write("%u,%s,%u,%d\n" % (t, TRACE_KINDS.get(kind, kind), arg, val))
+
+
+if __name__ == "__main__":
+    main()